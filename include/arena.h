@@ -0,0 +1,33 @@
+/*
+ * arena.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk; /* forward declaration */
+
+/**
+ * arena struct - a bump allocator whose memory is released all at once
+ * chunks    - the most recently allocated chunk, which links to older ones
+ * chunksize - the size of the next chunk to be allocated
+ * allocated - the total number of bytes held by the arena
+ */
+struct arena {
+    struct arena_chunk* chunks;
+    size_t chunksize;
+    size_t allocated;
+};
+
+void* arena_alloc(struct arena* a, const size_t size);
+struct arena* arena_create(const size_t chunksize);
+void arena_free(struct arena* a);
+char* arena_strndup(struct arena* a, const char* str, const size_t len);
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
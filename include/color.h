@@ -22,6 +22,8 @@ short add_color_rule(const enum color_object object,
                      const short fg,
                      const short bg);
 
+void expire_colors(void);
+
 void free_colors(void);
 
 int get_colors(const enum color_object object,
@@ -34,9 +36,8 @@ enum color_object parse_object(const char* name);
 
 int parse_color(const char* name);
 
+extern struct config cfg;
 extern FILE* logfp;
-extern struct task* head;
-extern WINDOW* tasklist;
 
 #endif
 
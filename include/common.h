@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 #include <time.h>
+#include <wchar.h>
 
 /* ncurses settings */
 enum ncurses_mode {
@@ -49,8 +50,14 @@ struct var {
 /**
  * task struct - the main structure in this program!
  * the fields thru description are data from the taskwarrior json
+ * project_id - the interned project, 0 if the task has none
+ * tag_ids    - the interned tags
+ * ntags      - the number of tags in tag_ids
+ * version    - a number unique to this task struct, a reloaded task gets a new one
  * selpair - the cached color pair to be used when this task is selected
  * pair    - the cached color pair to be used when this task is not selected
+ * colorgen - the color generation the cached pairs belong to, they are
+ *            stale once it differs from the current one
  * prev    - the previous task struct
  * next    - the next task struct
  */
@@ -63,12 +70,19 @@ struct task {
     time_t end;
     time_t entry;
     time_t due;
+    time_t modified;
     char* project;
     char priority;
     char* description;
-    /* color caching */
+    /* interned strings */
+    int project_id;
+    int* tag_ids;
+    unsigned short ntags;
+    /* display caching */
+    unsigned long version;
     int selpair;
     int pair;
+    unsigned long colorgen;
     /* linked list pointers */
     struct task* prev;
     struct task* next;
@@ -96,40 +110,55 @@ enum fmt_field_type {
     FIELD_TIME
 };
 
-struct conditional_fmt_field; /* forward declaration */
-
 /**
- * format field struct - for describing portions of format strings
+ * format field struct - one instruction of a compiled format string
  * type        - the field type which is to be printed
  * variable    - variable struct
  * field       - raw string data
- * conditional - a structure describing a conditional
  * length      - the length of the data contained
- * width       - the width that the field will be padded or cut to
+ * width       - the width that the field will be padded or cut to,
+ *               0 to print it as it is
  * right_align - whether the field should be right aligned
- * next        - the next format field struct
+ * condition   - the number of fields in the condition of a conditional,
+ *               which follow it
+ * positive    - the number of fields printed if the condition was true,
+ *               which follow the condition
+ * negative    - the number of fields printed if the condition was false,
+ *               which follow the positive fields
  */
 struct fmt_field {
     enum fmt_field_type type;
     struct var* variable;
     char* field;
-    struct conditional_fmt_field* conditional;
     unsigned int length;
     unsigned int width;
     bool right_align;
-    struct fmt_field* next;
+    int condition;
+    int positive;
+    int negative;
 };
 
 /**
- * conditional format field struct
- * condition - the condition to be evaluated
- * positive  - the string to be printed if condition was true
- * negative  - the string to be printed if condition was false
+ * format struct - a compiled format string
+ * fields   - the fields in the order they are printed, a conditional is
+ *            followed by its condition and both of its branches
+ * nfields  - the number of fields
+ * size     - the allocated number of fields
+ * depends  - the variables printed by the format
+ * values   - the values of depends when the format was last checked
+ * ndepends - the number of variables printed
+ * clock    - whether the format prints the current date or time
+ * minute   - the minute when the format was last checked
  */
-struct conditional_fmt_field {
-    struct fmt_field* condition;
-    struct fmt_field* positive;
-    struct fmt_field* negative;
+struct format {
+    struct fmt_field* fields;
+    int nfields;
+    int size;
+    struct var** depends;
+    char** values;
+    int ndepends;
+    bool clock;
+    time_t minute;
 };
 
 
@@ -166,6 +195,12 @@ enum log_mode {
  * version           - the task warrior version being wrapped
  * sortmode          - the active sort mode
  * follow_task       - whether a task will be followed when it moves in the list
+ * incremental       - whether reloads only fetch tasks modified since the last load
+ * backend           - where tasks are read from (export, data or sqlite)
+ * snapshot          - whether loaded tasks are cached for the next startup
+ * sort_parallel_min - the fewest tasks which are sorted on several threads
+ * sort_threads      - the number of threads to sort on, 0 for one per cpu
+ * due_soon          - the number of days before its due date a task is due soon
  * formats           - string and compiled printing formats
  * fieldlengths      - width of some task data fields
  */
@@ -177,13 +212,19 @@ struct config {
     char* version;
     char* sortmode;
     bool follow_task;
+    int incremental;
+    char* backend;
+    int snapshot;
+    int sort_parallel_min;
+    int sort_threads;
+    int due_soon;
     struct {
         char* task;
-        struct fmt_field* task_compiled;
+        struct format* task_compiled;
         char* title;
-        struct fmt_field* title_compiled;
+        struct format* title_compiled;
         char* view;
-        struct fmt_field* view_compiled;
+        struct format* view_compiled;
     } formats;
     struct {
         int description;
@@ -207,9 +248,14 @@ struct config {
 #define MIN(x, y)                       (x < y ? x : y)
 
 /* functions */
+void free_regex_cache(void);
 bool match_string(const char* haystack, const char* needle);
-char* utc_date(const time_t timeint);
-char* utc_time(const time_t timeint);
+bool regex_is_literal(const char* regex);
+int str_to_wide(const char* str, wchar_t* dst, const int maxcols, int* width);
+int str_width(const char* str, const int maxcols, size_t* bytes);
+char* utc_date(char* buf, const time_t timeint);
+char* utc_time(char* buf, const time_t timeint);
+const char* var_value(const struct var* v, char* buf, const size_t size);
 char* var_value_message(struct var* v, bool printname);
 
 #endif
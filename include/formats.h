@@ -7,13 +7,17 @@
 #ifndef _FIELDS_H
 #define _FIELDS_H
 
+#include <stdio.h>
 #include "common.h"
 
-struct fmt_field* compile_format_string(char* fmt);
-char* eval_format(struct fmt_field* fmts, struct task* tsks);
+struct format* compile_format_string(char* fmt);
+char* eval_format(const struct format* fmt, const struct task* tsk, char** buf, size_t* size);
 void compile_formats(void);
+bool format_changed(struct format* fmt);
 void free_formats(void);
 
+extern FILE* logfp;
+
 #endif
 
 // vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,50 @@
+/*
+ * json.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* json value types */
+enum json_type {
+    JSON_NONE,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_ARRAY,
+    JSON_OBJECT,
+    JSON_LITERAL
+};
+
+/**
+ * json parser struct - a cursor over a single json document
+ * pos    - the next character to be read
+ * end    - one past the last character of the document
+ * buf    - scratch buffer that escaped strings are decoded into
+ * buflen - the allocated size of buf
+ */
+struct json_parser {
+    const char* pos;
+    const char* end;
+    char* buf;
+    size_t buflen;
+};
+
+bool json_array_begin(struct json_parser* p);
+int json_array_next(struct json_parser* p);
+void json_free(struct json_parser* p);
+void json_init(struct json_parser* p, const char* str, const size_t len);
+bool json_int(struct json_parser* p, long* value);
+int json_next_member(struct json_parser* p, const char** key, size_t* keylen);
+bool json_object_begin(struct json_parser* p);
+enum json_type json_peek(struct json_parser* p);
+bool json_skip(struct json_parser* p);
+bool json_string(struct json_parser* p, const char** str, size_t* len);
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
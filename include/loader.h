@@ -0,0 +1,58 @@
+/*
+ * loader.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _LOADER_H
+#define _LOADER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include "arena.h"
+#include "common.h"
+#include "json.h"
+
+/**
+ * task loader struct - reads the output of an export command into tasks
+ * cmd       - the pipe the export is read from
+ * fd        - the file descriptor of the pipe
+ * arena     - the arena tasks are allocated from
+ * buf       - output which has been read but does not yet form a full line
+ * buflen    - the number of bytes held in buf
+ * bufsize   - the allocated size of buf
+ * json      - the parser reused for every line
+ * head      - the first task parsed and not yet taken
+ * last      - the last task parsed and not yet taken
+ * count     - the number of tasks parsed
+ * modified  - the latest modification time seen
+ * bytes     - the number of bytes parsed
+ * parsetime - the time spent parsing in seconds
+ */
+struct task_loader {
+    FILE* cmd;
+    int fd;
+    struct arena* arena;
+    char* buf;
+    size_t buflen;
+    size_t bufsize;
+    struct json_parser json;
+    struct task* head;
+    struct task* last;
+    int count;
+    time_t modified;
+    size_t bytes;
+    double parsetime;
+};
+
+struct task* loader_close(struct task_loader* l);
+bool loader_open(struct task_loader* l, const char* cmdstr, struct arena* arena, const bool nonblock);
+bool loader_read(struct task_loader* l);
+struct task* loader_take(struct task_loader* l);
+
+extern FILE* logfp;
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,25 @@
+/*
+ * schedule.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _SCHEDULE_H
+#define _SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include "common.h"
+
+void expire_schedule(void);
+void free_schedule(void);
+bool schedule_pop(const time_t now, struct task** tsk);
+
+extern struct config cfg;
+extern FILE* logfp;
+extern struct task* head;
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,26 @@
+/*
+ * snapshot.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "arena.h"
+#include "common.h"
+
+bool snapshot_read(const char* filter, struct arena* arena, struct task** tasks,
+                   time_t* modified, uint64_t* stamp);
+bool snapshot_write(const char* filter, const struct task* tasks, const time_t modified,
+                    const uint64_t stamp);
+
+extern FILE* logfp;
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
@@ -6,8 +6,25 @@
 
 #include <stdio.h>
 #include "common.h"
+#include "config.h"
 
-void sort_wrapper(struct task* first);
+void expire_sort_orders(void);
+void free_sort_plan(void);
+int sort_position(struct task* const* tasks, const int n, const struct task* tsk,
+                  const int pos);
+struct task* sort_wrapper(struct task* first);
+
+#ifdef TASKNC_INCLUDE_TESTS
+/* the sorts sort_wrapper picks between */
+enum sort_method {
+    SORT_MERGE,
+    SORT_PACKED,
+    SORT_PARALLEL
+};
+
+bool sort_array(struct task** tasks, const int n, const char* mode,
+                const enum sort_method method);
+#endif
 
 extern struct config cfg;
 extern FILE* logfp;
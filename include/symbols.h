@@ -0,0 +1,22 @@
+/*
+ * symbols.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include <stddef.h>
+
+void free_symbols(void);
+int intern(const char* str, const size_t len);
+int symbol_count(void);
+size_t symbol_length(const int id);
+const char* symbol_name(const int id);
+int symbol_rank(const int id);
+int symbol_width(const int id);
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,53 @@
+/*
+ * taskdata.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _TASKDATA_H
+#define _TASKDATA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "arena.h"
+#include "common.h"
+
+/* the most filter terms that can be evaluated natively */
+#define MAX_DATA_TERMS                  32
+
+/* filter term types */
+enum data_term_type {
+    TERM_STATUS,
+    TERM_PROJECT,
+    TERM_TAG,
+    TERM_NOTAG
+};
+
+/**
+ * data filter term struct - one term of a filter evaluated without task
+ * type  - what the term matches
+ * value - the value to match, which is not null terminated
+ * len   - the length of value
+ */
+struct data_term {
+    enum data_term_type type;
+    const char* value;
+    size_t len;
+};
+
+int compile_data_filter(const char* filter, struct data_term* terms);
+uint64_t data_stamp(void);
+const char* find_data_location(void);
+void free_data_location(void);
+bool match_data_filter(const struct data_term* terms, const int nterms, const struct task* tsk,
+                       const char* status, const size_t statuslen);
+bool read_data_file(const char* filter, const char* uuid, struct arena* arena,
+                    struct task** tasks, time_t* modified);
+
+extern FILE* logfp;
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,24 @@
+/*
+ * taskdb.h
+ * for tasknc
+ * by mjheagle
+ */
+
+#ifndef _TASKDB_H
+#define _TASKDB_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include "arena.h"
+#include "common.h"
+
+void close_task_db(void);
+bool read_task_db(const char* filter, const char* uuid, struct arena* arena,
+                  struct task** tasks, time_t* modified);
+
+extern FILE* logfp;
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
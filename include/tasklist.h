@@ -30,6 +30,7 @@ void key_tasklist_toggle_started(void);
 void key_tasklist_undo(void);
 void key_tasklist_view(void);
 void tasklist_check_curs_pos(void);
+void tasklist_free_line_cache(void);
 void tasklist_print_task(const int tasknum, const struct task* this, const int count);
 void tasklist_print_task_list(void);
 void tasklist_remove_task(struct task* this);
@@ -15,7 +15,7 @@
 #define wipe_tasklist()                 wipe_screen(tasklist, 0, rows-2)
 #define wipe_statusbar()                wipe_screen(statusbar, 0, 0)
 
-#define NVARS                           (int)(sizeof(vars)/sizeof(struct var))
+#define NVARS                           (int)(sizeof(vars)/sizeof(struct var) - 1)
 #define NFUNCS                          (int)(sizeof(funcmaps)/sizeof(struct funcmap))
 
 /* default settings */
@@ -28,6 +28,7 @@ void check_resize(void);
 void check_screen_size(void);
 void cleanup(void);
 void configure(void);
+void expire_header(void);
 struct funcmap* find_function(const char* name, const enum prog_mode mode);
 void find_next_search_result(struct task* head, struct task* pos);
 struct var* find_var(const char* name);
@@ -47,6 +48,8 @@ void print_version(void);
 void set_curses_mode(const enum ncurses_mode mode);
 char* str_trim(char* str);
 
+int umvaddnstr(WINDOW* win, const int y, const int x, const char* str, const int width);
+
 int umvaddstr(WINDOW* win,
               const int y,
               const int x,
@@ -8,25 +8,33 @@
 #define _TASKS_H
 
 #include <stdbool.h>
+#include "arena.h"
 #include "common.h"
+#include "json.h"
 
-char free_task(struct task* tsk);
-void free_tasks(struct task* head);
+void expire_tasks(void);
+void free_tasks(void);
 struct task* get_task_by_position(int n);
 int get_task_position_by_uuid(const char* uuid);
 struct task* get_tasks(char* uuid);
 unsigned short get_task_id(char* uuid);
-struct task* malloc_task(void);
-struct task* parse_task(char* line);
+void intern_task(struct task* tsk, struct arena* arena);
+bool load_snapshot(void);
+struct task* malloc_task(struct arena* arena);
+struct task* parse_task(struct json_parser* json, struct arena* arena);
+bool read_tasks_background(void);
 void reload_task(struct task* this);
 void reload_tasks(void);
-void remove_char(char* str, char remove);
+bool reload_tasks_background(void);
+void save_snapshot(void);
 void set_position_by_uuid(const char* uuid);
 int task_background_command(const char* cmdfmt);
 void task_count(void);
 int task_interactive_command(const char* cmdfmt);
+int tasks_loading_fd(void);
 bool task_match(const struct task* cur, const char* str);
 void task_modify(const char* argstr);
+void unindex_task(struct task* this);
 
 extern FILE* logfp;
 extern struct task* head;
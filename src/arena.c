@@ -0,0 +1,120 @@
+/*
+ * arena.c - chunked bump allocator
+ * for tasknc
+ * by mjheagle
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* alignment of every allocation */
+#define ARENA_ALIGN                     16
+
+/* largest chunk that growth will request */
+#define ARENA_MAX_CHUNK                 (4 << 20)
+
+/**
+ * arena chunk struct - one block of memory owned by an arena
+ * next - the previously allocated chunk
+ * size - the usable size of data
+ * used - the number of bytes of data handed out
+ * data - the memory handed out by the arena
+ */
+struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+void* arena_alloc(struct arena* a, const size_t size) { /* {{{ */
+    /**
+     * allocate zeroed memory from an arena
+     * a    - the arena to allocate from
+     * size - the number of bytes requested
+     * return is the allocated memory, or NULL if allocation failed
+     */
+    struct arena_chunk* chunk = a->chunks;
+    size_t              aligned = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    size_t              chunksize;
+    void*               ret;
+
+    /* grow the arena if the current chunk is full */
+    if (chunk == NULL || chunk->size - chunk->used < aligned) {
+        chunksize = aligned > a->chunksize ? aligned : a->chunksize;
+        chunk = malloc(sizeof(struct arena_chunk) + chunksize);
+
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        chunk->size = chunksize;
+        chunk->used = 0;
+        chunk->next = a->chunks;
+        a->chunks = chunk;
+        a->allocated += chunksize;
+
+        if (a->chunksize < ARENA_MAX_CHUNK) {
+            a->chunksize *= 2;
+        }
+    }
+
+    ret = chunk->data + chunk->used;
+    chunk->used += aligned;
+    memset(ret, 0, size);
+
+    return ret;
+} /* }}} */
+
+struct arena* arena_create(const size_t chunksize) { /* {{{ */
+    /**
+     * create an empty arena
+     * chunksize - the size of the first chunk, later chunks double in size
+     * return is the new arena, or NULL if allocation failed
+     */
+    struct arena* a = calloc(1, sizeof(struct arena));
+
+    if (a == NULL) {
+        return NULL;
+    }
+
+    a->chunksize = chunksize > 0 ? chunksize : 4096;
+
+    return a;
+} /* }}} */
+
+void arena_free(struct arena* a) { /* {{{ */
+    /* release an arena and everything allocated from it */
+    struct arena_chunk* chunk;
+    struct arena_chunk* next;
+
+    if (a == NULL) {
+        return;
+    }
+
+    for (chunk = a->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(a);
+} /* }}} */
+
+char* arena_strndup(struct arena* a, const char* str, const size_t len) { /* {{{ */
+    /**
+     * copy a string of known length into an arena
+     * str - the string to copy, which need not be terminated
+     * len - the number of characters to copy
+     * return is the terminated copy
+     */
+    char* ret = arena_alloc(a, len + 1);
+
+    if (ret != NULL) {
+        memcpy(ret, str, len);
+    }
+
+    return ret;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
@@ -6,13 +6,18 @@
 
 #define _GNU_SOURCE
 
+#include <ctype.h>
 #include <curses.h>
+#include <regex.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "color.h"
 #include "common.h"
 #include "log.h"
+#include "symbols.h"
 #include "tasks.h"
 
 /**
@@ -27,18 +32,69 @@ struct color {
     short bg;
 };
 
+/* initial number of pair map slots, a power of two */
+#define PAIR_MAP_MIN                    64
+
+/**
+ * pair slot structure - an entry of the hash map from colors to pairs
+ * fg   - the foreground color
+ * bg   - the background color
+ * pair - the color pair number, 0 for an empty slot
+ */
+struct pair_slot {
+    short fg;
+    short bg;
+    short pair;
+};
+
+/* the task properties a rule term can test */
+enum rule_field {
+    RULE_SELECTED,
+    RULE_STARTED,
+    RULE_PROJECT,
+    RULE_DESCRIPTION,
+    RULE_TAGS,
+    RULE_PRIORITY,
+    RULE_OVERDUE,
+    RULE_DUE_SOON
+};
+
+/**
+ * rule term structure - one ~x test of a color rule
+ * field    - the task property tested
+ * invert   - whether the term is true when the test fails
+ * literal  - the pattern, if it can be matched as a plain substring
+ * regex    - the compiled pattern otherwise
+ * compiled - whether regex holds a compiled pattern
+ */
+struct rule_term {
+    enum rule_field field;
+    bool invert;
+    char* literal;
+    regex_t regex;
+    bool compiled;
+};
+
 /**
  * color rule structure
  * pair   - the color pair number to be passed to COLOR_PAIR
  * rule   - the string containing the rule to be evaluated
+ * terms  - the tests the rule was parsed to, all of which must pass
+ * nterms - the number of terms
+ * valid  - whether the rule could be parsed, an invalid rule never matches
  * object - the type of item that is being colored
  * next   - the next color_rule struct
+ * prev   - the previous color_rule struct
  */
 struct color_rule {
     short pair;
     char* rule;
+    struct rule_term* terms;
+    int nterms;
+    bool valid;
     enum color_object object;
     struct color_rule* next;
+    struct color_rule* prev;
 };
 
 /* global variables */
@@ -46,6 +102,19 @@ bool use_colors;
 bool colors_initialized = false;
 bool* pairs_used = NULL;
 struct color_rule* color_rules = NULL;
+struct color_rule* color_rules_last = NULL;
+
+/* the color generation cached task colors must match, 0 is never current */
+static unsigned long color_generation = 1;
+
+/* open addressed hash map of the pairs in use by their colors */
+static struct pair_slot* pair_map = NULL;
+static unsigned int pair_map_mask = 0;
+static int pair_map_count = 0;
+
+/* pairs are never released, so every pair from this one up is free unless
+ * it was requested by number */
+static int next_free_pair = 1;
 
 /* local functions */
 static short add_color_pair(const short askpair,
@@ -54,13 +123,28 @@ static short add_color_pair(const short askpair,
 
 int check_color(int color);
 
-static bool eval_rules(char* rule,
-                       const struct task*,
-                       const bool selected);
+static bool eval_rule(const struct color_rule* rule,
+                      const struct task* tsk,
+                      const bool selected);
 
 static short find_add_pair(const short fg,
                            const short bg);
 
+static unsigned int hash_pair(const short fg,
+                              const short bg);
+
+static short lookup_pair(const short fg,
+                         const short bg);
+
+static bool map_pair(const short pair,
+                     const short fg,
+                     const short bg);
+
+static bool match_term(const struct rule_term* term,
+                       const char* str);
+
+static bool parse_rule(struct color_rule* this);
+
 static int set_default_colors(void);
 
 short add_color_pair(short askpair, short fg, short bg) { /* {{{ */
@@ -70,17 +154,19 @@ short add_color_pair(short askpair, short fg, short bg) { /* {{{ */
      * fg      - the foreground color to be stored
      * bg      - the background color to be stored
      */
-    short pair = 1;
+    short pair;
 
     /* pick a color number if none is specified */
     if (askpair <= 0) {
-        while (pair < COLOR_PAIRS && pairs_used[pair]) {
-            pair++;
+        while (next_free_pair < COLOR_PAIRS && pairs_used[next_free_pair]) {
+            next_free_pair++;
         }
 
-        if (pair == COLOR_PAIRS) {
+        if (next_free_pair >= COLOR_PAIRS) {
             return -1;
         }
+
+        pair = next_free_pair;
     }
 
     /* check if pair requested is being used */
@@ -93,7 +179,7 @@ short add_color_pair(short askpair, short fg, short bg) { /* {{{ */
     }
 
     /* initialize pair */
-    if (init_pair(pair, fg, bg) == ERR) {
+    if (init_pair(pair, fg, bg) == ERR || !map_pair(pair, fg, bg)) {
         return -1;
     }
 
@@ -121,18 +207,9 @@ short add_color_rule(const enum color_object object,
     struct color_rule*  last;
     struct color_rule*  this;
     short               ret;
-    struct task*        tsk;
-
-    /* reset color caches if past configuration */
-    if (tasklist != NULL) {
-        tsk = head;
 
-        while (tsk != NULL) {
-            tsk->selpair = -1;
-            tsk->pair = -1;
-            tsk = tsk->next;
-        }
-    }
+    /* the cached colors of every task are stale */
+    expire_colors();
 
     /* look for existing rule and overwrite colors */
     this = color_rules;
@@ -173,6 +250,8 @@ short add_color_rule(const enum color_object object,
 
     this->object = object;
     this->next = NULL;
+    this->prev = last;
+    this->valid = parse_rule(this);
 
     if (last != NULL) {
         last->next = this;
@@ -180,6 +259,8 @@ short add_color_rule(const enum color_object object,
         color_rules = this;
     }
 
+    color_rules_last = this;
+
     return 0;
 } /* }}} */
 
@@ -195,128 +276,81 @@ int check_color(int color) { /* {{{ */
     }
 } /* }}} */
 
-bool eval_rules(char* rule, const struct task* tsk, const bool selected) { /* {{{ */
+void expire_colors(void) { /* {{{ */
+    /* make the cached colors of every task stale */
+    color_generation++;
+} /* }}} */
+
+bool eval_rule(const struct color_rule* rule, const struct task* tsk,
+               const bool selected) { /* {{{ */
     /**
-     * evaluate a rule set for a task
+     * evaluate a parsed rule for a task
      * rule     - the rule to be evaluated
      * tsk      - the task the rule will be evaluated on
      * selected - whether the task is selected
      */
-    char*   regex = NULL;
-    char    pattern;
-    char*   tmp;
-    int     ret;
-    int     move;
-    bool    go = false;
-    bool    invert = false;
-
-    /* success if rules are done */
-    if (rule == NULL || *rule == 0) {
-        return true;
-    }
-
-    /* skip non-patterns */
-    if (*rule != '~') {
-        return eval_rules(rule + 1, tsk, selected);
+    const struct rule_term* term;
+    char                    priority[2];
+    bool                    match = false;
+    unsigned short          i;
+    time_t                  now = 0;
+
+    if (!rule->valid) {
+        return false;
     }
 
-    /* regex match */
-    ret = sscanf(rule, "~%c '%m[^\']'", &pattern, &regex);
-
-    if (ret > 0 && pattern >= 'A' && pattern <= 'Z') {
-        pattern += 32;
-        invert = true;
-    }
-
-    if (ret == 1) {
-        switch (pattern) {
-        case 's':
-            if (!XOR(invert, selected)) {
-                return false;
-            } else {
-                return eval_rules(rule + 2, tsk, selected);
-            }
-
+    for (term = rule->terms; term < rule->terms + rule->nterms; term++) {
+        switch (term->field) {
+        case RULE_SELECTED:
+            match = selected;
             break;
 
-        case 't':
-            if (!XOR(invert, tsk->start > 0)) {
-                return false;
-            } else {
-                return eval_rules(rule + 2, tsk, selected);
-            }
-
+        case RULE_STARTED:
+            match = tsk->start > 0;
             break;
 
-        default:
+        case RULE_PROJECT:
+            match = match_term(term, tsk->project);
             break;
-        }
-    }
-
-    if (ret == 2) {
-        move = strlen(regex) + 3;
-        go = true;
-
-        switch (pattern) {
-        case 'p':
-            if (!XOR(invert, match_string(tsk->project, regex))) {
-                return false;
-            } else {
-                tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "eval_rules: project match - '%s' '%s'",
-                            tsk->project, regex);
-            }
 
+        case RULE_DESCRIPTION:
+            match = match_term(term, tsk->description);
             break;
 
-        case 'd':
-            if (!XOR(invert, match_string(tsk->description, regex))) {
-                return false;
-            } else {
-                tnc_fprintf(logfp, LOG_DEBUG_VERBOSE,
-                            "eval_rules: description match - '%s' '%s'", tsk->description, regex);
+        case RULE_TAGS:
+            for (i = 0, match = false; i < tsk->ntags && !match; i++) {
+                match = match_term(term, symbol_name(tsk->tag_ids[i]));
             }
 
             break;
 
-        case 't':
-            if (!XOR(invert, match_string(tsk->tags, regex))) {
-                return false;
-            } else {
-                tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "eval_rules: tag match - '%s' '%s'",
-                            tsk->tags, regex);
-            }
-
+        case RULE_PRIORITY:
+            priority[0] = tsk->priority;
+            priority[1] = 0;
+            match = match_term(term, priority);
             break;
 
-        case 'r':
-            tmp = calloc(2, sizeof(char));
-            *tmp = tsk->priority;
+        case RULE_OVERDUE:
+        case RULE_DUE_SOON:
+            if (now == 0) {
+                now = time(NULL);
+            }
 
-            if (!XOR(invert, match_string(tmp, regex))) {
-                return false;
+            if (term->field == RULE_OVERDUE) {
+                match = tsk->due != 0 && tsk->due <= now;
             } else {
-                tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "eval_rules: priority match - '%s' '%s'",
-                            tmp, regex);
+                match = tsk->due > now && tsk->due <= now + (time_t)cfg.due_soon * 86400;
             }
 
-            free(tmp);
-            break;
-
-        default:
-            go = false;
             break;
         }
 
-        free(regex);
-
-        if (go) {
-            return eval_rules(rule + move, tsk, selected);
+        if (match == term->invert) {
+            return false;
         }
     }
 
-    /* should never get here */
-    tnc_fprintf(logfp, LOG_ERROR, "malformed rules - \"%s\"", rule);
-    return false;
+    return true;
 } /* }}} */
 
 short find_add_pair(const short fg, const short bg) { /* {{{ */
@@ -325,31 +359,14 @@ short find_add_pair(const short fg, const short bg) { /* {{{ */
      * fg - the foreground color
      * bg - the background color
      */
-    short tmpfg;
-    short tmpbg;
-    int pair;
-    int free_pair = -1;
-    int   ret;
-
-    /* look for an existing pair */
-    for (pair = 1; pair < COLOR_PAIRS; pair++) {
-        if (pairs_used[pair]) {
-            ret = pair_content(pair, &tmpfg, &tmpbg);
-
-            if (ret == ERR) {
-                continue;
-            }
+    short pair = lookup_pair(fg, bg);
 
-            if (tmpfg == fg && tmpbg == bg) {
-                return pair;
-            }
-        } else if (free_pair == -1) {
-            free_pair = pair;
-        }
+    if (pair > 0) {
+        return pair;
     }
 
     /* return a new pair */
-    return add_color_pair(free_pair, fg, bg);
+    return add_color_pair(-1, fg, bg);
 } /* }}} */
 
 void free_colors(void) { /* {{{ */
@@ -357,7 +374,14 @@ void free_colors(void) { /* {{{ */
     struct color_rule* this;
     struct color_rule* last;
 
+    int                 i;
+
     check_free(pairs_used);
+    free(pair_map);
+    pair_map = NULL;
+    pair_map_mask = 0;
+    pair_map_count = 0;
+    next_free_pair = 1;
 
     this = color_rules;
 
@@ -365,8 +389,21 @@ void free_colors(void) { /* {{{ */
         last = this;
         this = this->next;
         check_free(last->rule);
+
+        for (i = 0; i < last->nterms; i++) {
+            free(last->terms[i].literal);
+
+            if (last->terms[i].compiled) {
+                regfree(&(last->terms[i].regex));
+            }
+        }
+
+        free(last->terms);
         free(last);
     }
+
+    color_rules = NULL;
+    color_rules_last = NULL;
 } /* }}} */
 
 int get_colors(const enum color_object object,
@@ -381,10 +418,15 @@ int get_colors(const enum color_object object,
     short               pair = 0;
     int*                tskpair;
     struct color_rule*  rule;
-    bool                done = false;
 
     /* check for cache if task */
     if (object == OBJECT_TASK) {
+        if (tsk->colorgen != color_generation) {
+            tsk->colorgen = color_generation;
+            tsk->pair = -1;
+            tsk->selpair = -1;
+        }
+
         if (selected) {
             tskpair = &(tsk->selpair);
         } else {
@@ -396,36 +438,23 @@ int get_colors(const enum color_object object,
         }
     }
 
-    /* iterate through rules */
-    rule = color_rules;
-
-    while (rule != NULL) {
-        /* check for matching object */
-        if (object == rule->object) {
-            switch (object) {
-            case OBJECT_ERROR:
-            case OBJECT_HEADER:
-                done = true;
-                break;
-
-            case OBJECT_TASK:
-                if (eval_rules(rule->rule, tsk, selected)) {
-                    pair = rule->pair;
-                }
-
-                break;
-
-            default:
+    /* the last matching task rule wins, so search from the end */
+    if (object == OBJECT_TASK) {
+        for (rule = color_rules_last; rule != NULL; rule = rule->prev) {
+            if (rule->object == object && eval_rule(rule, tsk, selected)) {
+                pair = rule->pair;
                 break;
             }
         }
-
-        if (done) {
-            pair = rule->pair;
-            break;
+    }
+    /* other objects use their first rule */
+    else {
+        for (rule = color_rules; rule != NULL; rule = rule->next) {
+            if (rule->object == object) {
+                pair = rule->pair;
+                break;
+            }
         }
-
-        rule = rule->next;
     }
 
     /* assign cached color if task object */
@@ -436,6 +465,13 @@ int get_colors(const enum color_object object,
     return COLOR_PAIR(pair);
 } /* }}} */
 
+unsigned int hash_pair(const short fg, const short bg) { /* {{{ */
+    /* hash a foreground and background color */
+    uint32_t key = ((uint32_t)(uint16_t)fg << 16) | (uint16_t)bg;
+
+    return (key * 2654435761u) >> 13;
+} /* }}} */
+
 int init_colors(void) { /* {{{ */
     /* initialize curses colors */
     int ret;
@@ -470,6 +506,86 @@ int init_colors(void) { /* {{{ */
     }
 } /* }}} */
 
+short lookup_pair(const short fg, const short bg) { /* {{{ */
+    /* look up the pair in use for a foreground and background, 0 if none is */
+    unsigned int slot;
+
+    if (pair_map == NULL) {
+        return 0;
+    }
+
+    for (slot = hash_pair(fg, bg) & pair_map_mask; pair_map[slot].pair != 0;
+         slot = (slot + 1) & pair_map_mask) {
+        if (pair_map[slot].fg == fg && pair_map[slot].bg == bg) {
+            return pair_map[slot].pair;
+        }
+    }
+
+    return 0;
+} /* }}} */
+
+bool map_pair(const short pair, const short fg, const short bg) { /* {{{ */
+    /**
+     * add a pair to the map from colors to pairs
+     * pair - the pair number
+     * fg   - the foreground color of the pair
+     * bg   - the background color of the pair
+     * return is whether the pair could be added
+     */
+    struct pair_slot*   newmap;
+    unsigned int        newmask;
+    unsigned int        slot;
+    unsigned int        i;
+
+    /* grow the map, keeping it at most half full */
+    if (2 * (unsigned int)(pair_map_count + 1) > pair_map_mask) {
+        newmask = pair_map == NULL ? PAIR_MAP_MIN - 1 : 2 * pair_map_mask + 1;
+        newmap = calloc(newmask + 1, sizeof(struct pair_slot));
+
+        if (newmap == NULL) {
+            return false;
+        }
+
+        for (i = 0; pair_map != NULL && i <= pair_map_mask; i++) {
+            if (pair_map[i].pair == 0) {
+                continue;
+            }
+
+            for (slot = hash_pair(pair_map[i].fg, pair_map[i].bg) & newmask; newmap[slot].pair != 0;
+                 slot = (slot + 1) & newmask);
+
+            newmap[slot] = pair_map[i];
+        }
+
+        free(pair_map);
+        pair_map = newmap;
+        pair_map_mask = newmask;
+    }
+
+    for (slot = hash_pair(fg, bg) & pair_map_mask; pair_map[slot].pair != 0;
+         slot = (slot + 1) & pair_map_mask);
+
+    pair_map[slot].fg = fg;
+    pair_map[slot].bg = bg;
+    pair_map[slot].pair = pair;
+    pair_map_count++;
+
+    return true;
+} /* }}} */
+
+bool match_term(const struct rule_term* term, const char* str) { /* {{{ */
+    /* check whether a string matches the pattern of a rule term */
+    if (str == NULL) {
+        return false;
+    }
+
+    if (term->literal != NULL) {
+        return strcasestr(str, term->literal) != NULL;
+    }
+
+    return term->compiled && regexec(&(term->regex), str, 0, NULL, 0) == 0;
+} /* }}} */
+
 int parse_color(const char* name) { /* {{{ */
     /* parse a color from a string */
     unsigned int    i;
@@ -541,6 +657,136 @@ enum color_object parse_object(const char* name) { /* {{{ */
     return OBJECT_NONE;
 } /* }}} */
 
+bool parse_rule(struct color_rule* this) { /* {{{ */
+    /**
+     * parse the text of a rule into the terms it tests
+     * this - the rule, whose terms will be set
+     * return is whether the rule was valid
+     * a rule is a series of ~x tests, each optionally followed by a quoted
+     * regex, where an uppercase x inverts the test
+     */
+    struct rule_term*   term;
+    struct rule_term*   tmp;
+    const char*         pos = this->rule;
+    const char*         end;
+    char*               regex;
+    char                pattern;
+    int                 size = 0;
+
+    this->terms = NULL;
+    this->nterms = 0;
+
+    for (; pos != NULL && *pos != 0; pos++) {
+        /* skip non-patterns */
+        if (*pos != '~') {
+            continue;
+        }
+
+        pattern = tolower((unsigned char)pos[1]);
+
+        if (pattern == 0) {
+            goto malformed;
+        }
+
+        if (this->nterms >= size) {
+            size = 2 * size + 2;
+            tmp = realloc(this->terms, size * sizeof(struct rule_term));
+
+            if (tmp == NULL) {
+                goto malformed;
+            }
+
+            this->terms = tmp;
+        }
+
+        term = &(this->terms[this->nterms++]);
+        memset(term, 0, sizeof(struct rule_term));
+        term->invert = isupper((unsigned char)pos[1]);
+        pos += 2;
+
+        /* find the quoted regex, if any */
+        while (isspace((unsigned char)*pos)) {
+            pos++;
+        }
+
+        regex = NULL;
+
+        if (*pos == '\'' && pos[1] != '\'' && pos[1] != 0) {
+            end = strchr(pos + 1, '\'');
+
+            if (end == NULL) {
+                end = pos + strlen(pos);
+            }
+
+            regex = strndup(pos + 1, end - pos - 1);
+            pos = *end == 0 ? end - 1 : end;
+        } else {
+            pos--;
+        }
+
+        switch (pattern) {
+        case 's':
+            term->field = RULE_SELECTED;
+            break;
+
+        case 't':
+            term->field = regex != NULL ? RULE_TAGS : RULE_STARTED;
+            break;
+
+        case 'p':
+            term->field = RULE_PROJECT;
+            break;
+
+        case 'd':
+            term->field = RULE_DESCRIPTION;
+            break;
+
+        case 'r':
+            term->field = RULE_PRIORITY;
+            break;
+
+        case 'o':
+            term->field = RULE_OVERDUE;
+            break;
+
+        case 'u':
+            term->field = RULE_DUE_SOON;
+            break;
+
+        default:
+            free(regex);
+            goto malformed;
+        }
+
+        /* check that the test takes a regex only if it needs one */
+        if ((regex != NULL) != (term->field != RULE_SELECTED && term->field != RULE_STARTED &&
+                                 term->field != RULE_OVERDUE && term->field != RULE_DUE_SOON)) {
+            free(regex);
+            goto malformed;
+        }
+
+        /* compile the regex once, a regex which does not compile matches nothing */
+        if (regex != NULL) {
+            if (regex_is_literal(regex)) {
+                term->literal = regex;
+            } else {
+                term->compiled = regcomp(&(term->regex), regex, REGEX_OPTS) == 0;
+                free(regex);
+            }
+        }
+    }
+
+    tnc_fprintf(logfp, LOG_DEBUG, "parsed color rule \"%s\" to %d terms",
+                this->rule != NULL ? this->rule : "", this->nterms);
+
+    return true;
+
+malformed:
+    tnc_fprintf(logfp, LOG_ERROR, "malformed rules - \"%s\"", this->rule);
+
+    return false;
+} /* }}} */
+
 int set_default_colors(void) { /* {{{ */
     /* create initial color rules */
     add_color_rule(OBJECT_HEADER, NULL, COLOR_BLUE, COLOR_BLACK);
@@ -258,6 +258,7 @@ void run_command_color(char* args) { /* {{{ */
     /* create color rule */
     if (add_color_rule(obj, rule, fgc, bgc) >= 0) {
         statusbar_message(cfg.statusbar_timeout, "applied color rule");
+        redraw = true;
     } else {
         statusbar_message(cfg.statusbar_timeout, "applying color rule failed");
     }
@@ -10,122 +10,347 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
 #include "common.h"
 #include "config.h"
 
+/* the number of compiled regexes kept for reuse */
+#define REGEX_CACHE_SIZE                8
+
+/**
+ * regex cache entry struct - a compiled regex kept for reuse
+ * pattern  - the regex text, NULL for an unused entry
+ * flags    - the flags the regex was compiled with
+ * regex    - the compiled regex
+ * compiled - whether the regex compiled, a regex which did not matches nothing
+ * used     - when the entry was last used, for evicting the oldest
+ */
+struct regex_entry {
+    char* pattern;
+    int flags;
+    regex_t regex;
+    bool compiled;
+    unsigned long used;
+};
+
+/* local functions */
+static const struct regex_entry* cached_regex(const char* pattern, const int flags);
+static size_t decode_char(const char* str, mbstate_t* state, wchar_t* wc, int* width);
+
+/* recently used regexes */
+static struct regex_entry regex_cache[REGEX_CACHE_SIZE];
+static unsigned long regex_clock = 0;
+
 /* externs */
 extern int selline;
 
+const struct regex_entry* cached_regex(const char* pattern, const int flags) { /* {{{ */
+    /**
+     * find a compiled regex, compiling it if it was not used recently
+     * pattern - the regex text
+     * flags   - the flags to pass to regcomp
+     * return is the cache entry, or NULL if it could not be stored
+     */
+    struct regex_entry* entry;
+    struct regex_entry* oldest = regex_cache;
+
+    for (entry = regex_cache; entry < regex_cache + REGEX_CACHE_SIZE; entry++) {
+        if (entry->pattern != NULL && entry->flags == flags &&
+            str_eq(entry->pattern, pattern)) {
+            entry->used = ++regex_clock;
+            return entry;
+        }
+
+        if (entry->used < oldest->used) {
+            oldest = entry;
+        }
+    }
+
+    /* replace the least recently used entry */
+    entry = oldest;
+
+    if (entry->pattern != NULL) {
+        free(entry->pattern);
+
+        if (entry->compiled) {
+            regfree(&(entry->regex));
+        }
+    }
+
+    entry->pattern = strdup(pattern);
+
+    if (entry->pattern == NULL) {
+        entry->used = 0;
+        return NULL;
+    }
+
+    entry->flags = flags;
+    entry->compiled = regcomp(&(entry->regex), pattern, flags) == 0;
+    entry->used = ++regex_clock;
+
+    return entry;
+} /* }}} */
+
+size_t decode_char(const char* str, mbstate_t* state, wchar_t* wc,
+                   int* width) { /* {{{ */
+    /**
+     * decode the next character of a utf-8 string
+     * str   - the string, which must not be at its end
+     * state - the conversion state
+     * wc    - where the wide character will be stored
+     * width - where the number of columns the character takes will be stored
+     * return is the number of bytes decoded
+     * invalid bytes are decoded as '?' and control characters such as tabs
+     * as spaces, so that every character has a known width
+     */
+    size_t n = mbrtowc(wc, str, MB_CUR_MAX, state);
+
+    if (n == (size_t) - 1 || n == (size_t) - 2 || n == 0) {
+        memset(state, 0, sizeof(mbstate_t));
+        *wc = L'?';
+        n = 1;
+    }
+
+    *width = wcwidth(*wc);
+
+    if (*width < 0) {
+        *wc = L' ';
+        *width = 1;
+    }
+
+    return n;
+} /* }}} */
+
+void free_regex_cache(void) { /* {{{ */
+    /* release every cached regex */
+    struct regex_entry* entry;
+
+    for (entry = regex_cache; entry < regex_cache + REGEX_CACHE_SIZE; entry++) {
+        if (entry->pattern != NULL && entry->compiled) {
+            regfree(&(entry->regex));
+        }
+
+        free(entry->pattern);
+    }
+
+    memset(regex_cache, 0, sizeof(regex_cache));
+    regex_clock = 0;
+} /* }}} */
+
 bool match_string(const char* haystack, const char* needle) { /* {{{ */
     /* find the regex needle in a haystack */
-    regex_t regex;
-    bool    ret;
+    const struct regex_entry* entry;
 
     /* check for NULL haystack or needle */
     if (haystack == NULL || needle == NULL) {
         return false;
     }
 
-    /* compile regex */
-    if (regcomp(&regex, needle, REGEX_OPTS) != 0) {
-        return false;
+    /* a plain string needs no regex */
+    if (regex_is_literal(needle)) {
+        return strcasestr(haystack, needle) != NULL;
     }
 
-    /* run regex */
-    if (regexec(&regex, haystack, 0, 0, 0) != REG_NOMATCH) {
-        ret = true;
-    } else {
-        ret = false;
+    /* run the compiled regex */
+    entry = cached_regex(needle, REGEX_OPTS);
+
+    return entry != NULL && entry->compiled &&
+           regexec(&(entry->regex), haystack, 0, 0, 0) != REG_NOMATCH;
+} /* }}} */
+
+bool regex_is_literal(const char* regex) { /* {{{ */
+    /**
+     * check whether a regex only matches its own text
+     * regex - the extended regex to check
+     * return is true if it is printable ascii without special characters,
+     * in which case a case insensitive substring search gives the same result
+     */
+    for (; *regex != 0; regex++) {
+        if (*regex < ' ' || *regex > '~' || strchr(".[]()*+?{}|^$\\", *regex) != NULL) {
+            return false;
+        }
     }
 
-    regfree(&regex);
-    return ret;
+    return true;
 } /* }}} */
 
-char* utc_date(const time_t timeint) { /* {{{ */
-    /* convert a utc time uint to a string */
-    struct tm*  tmr;
-    struct tm*  now;
-    time_t      cur;
-    char*       timestr;
+int str_to_wide(const char* str, wchar_t* dst, const int maxcols, int* width) { /* {{{ */
+    /**
+     * decode as much of a utf-8 string as fits in a number of columns
+     * str     - the string to decode
+     * dst     - where the wide characters will be stored, which needs
+     *           room for as many characters as str has bytes
+     * maxcols - the most columns to fill, or -1 for the whole string
+     * width   - where the number of columns filled will be stored, or NULL
+     * return is the number of wide characters stored
+     */
+    mbstate_t   state;
+    wchar_t     wc;
+    size_t      n;
+    int         count = 0;
+    int         used = 0;
+    int         w;
 
-    /* get current time */
-    time(&cur);
-    now = localtime(&cur);
+    memset(&state, 0, sizeof(state));
 
-    /* set time to either now or the specified time */
-    tmr = timeint == 0  ?  now : localtime(&timeint);
+    while (*str != 0) {
+        n = decode_char(str, &state, &wc, &w);
 
-    /* convert thte time to a formatted string */
-    timestr = malloc(TIMELENGTH * sizeof(char));
+        if (maxcols >= 0 && used + w > maxcols) {
+            break;
+        }
 
-    if (now->tm_year != tmr->tm_year) {
-        strftime(timestr, TIMELENGTH, "%F", tmr);
-    } else {
-        strftime(timestr, TIMELENGTH, "%b %d", tmr);
+        dst[count++] = wc;
+        used += w;
+        str += n;
+    }
+
+    if (width != NULL) {
+        *width = used;
+    }
+
+    return count;
+} /* }}} */
+
+int str_width(const char* str, const int maxcols, size_t* bytes) { /* {{{ */
+    /**
+     * measure the columns a utf-8 string takes on screen
+     * str     - the string to measure
+     * maxcols - the most columns to count, or -1 for the whole string
+     * bytes   - where the length of the part counted will be stored, or NULL
+     * return is the number of columns of the part counted
+     */
+    const char* start = str;
+    mbstate_t   state;
+    wchar_t     wc;
+    size_t      n;
+    int         used = 0;
+    int         w;
+
+    memset(&state, 0, sizeof(state));
+
+    while (*str != 0) {
+        n = decode_char(str, &state, &wc, &w);
+
+        if (maxcols >= 0 && used + w > maxcols) {
+            break;
+        }
+
+        used += w;
+        str += n;
+    }
+
+    if (bytes != NULL) {
+        *bytes = str - start;
     }
 
-    return timestr;
+    return used;
 } /* }}} */
 
-char* utc_time(const time_t timeint) { /* {{{ */
-    /* convert a utc time uint to a string */
-    struct tm*  tmr;
-    struct tm*  now;
+char* utc_date(char* buf, const time_t timeint) { /* {{{ */
+    /* convert a utc time uint to a string
+     * buf     - where the string will be stored, TIMELENGTH bytes long
+     * timeint - the time to convert, or 0 for now
+     * return is buf
+     */
+    struct tm   tmr;
+    struct tm   now;
     time_t      cur;
-    char*       timestr;
 
     /* get current time */
     time(&cur);
-    now = localtime(&cur);
+    localtime_r(&cur, &now);
 
     /* set time to either now or the specified time */
-    tmr = timeint == 0  ?  now : localtime(&timeint);
+    if (timeint == 0) {
+        tmr = now;
+    } else {
+        localtime_r(&timeint, &tmr);
+    }
 
-    /* convert thte time to a formatted string */
-    timestr = malloc(TIMELENGTH * sizeof(char));
-    strftime(timestr, TIMELENGTH, "%H:%M", tmr);
+    /* convert the time to a formatted string */
+    if (now.tm_year != tmr.tm_year) {
+        strftime(buf, TIMELENGTH, "%F", &tmr);
+    } else {
+        strftime(buf, TIMELENGTH, "%b %d", &tmr);
+    }
 
-    return timestr;
+    return buf;
 } /* }}} */
 
-char* var_value_message(struct var* v, bool printname) { /* {{{ */
-    /* format a message containing the name and value of a variable */
-    char* message;
-    char* value;
+char* utc_time(char* buf, const time_t timeint) { /* {{{ */
+    /* convert a utc time uint to a string
+     * buf     - where the string will be stored, TIMELENGTH bytes long
+     * timeint - the time to convert, or 0 for now
+     * return is buf
+     */
+    struct tm   tmr;
+    time_t      cur;
+
+    /* set time to either now or the specified time */
+    if (timeint == 0) {
+        time(&cur);
+        localtime_r(&cur, &tmr);
+    } else {
+        localtime_r(&timeint, &tmr);
+    }
 
+    strftime(buf, TIMELENGTH, "%H:%M", &tmr);
+
+    return buf;
+} /* }}} */
+
+const char* var_value(const struct var* v, char* buf, const size_t size) { /* {{{ */
+    /**
+     * get the value of a variable as a string
+     * v    - the variable
+     * buf  - where numbers and characters will be formatted
+     * size - the size of buf
+     * return is either buf or the string the variable holds, which is
+     * NULL for an unset string
+     */
     switch (v->type) {
     case VAR_INT:
         if (str_eq(v->name, "selected_line")) {
-            asprintf(&value, "%d", selline + 1);
+            snprintf(buf, size, "%d", selline + 1);
         } else {
-            asprintf(&value, "%d", *(int*)(v->ptr));
+            snprintf(buf, size, "%d", *(int*)(v->ptr));
         }
 
-        break;
+        return buf;
 
     case VAR_CHAR:
-        asprintf(&value, "%c", *(char*)(v->ptr));
-        break;
+        snprintf(buf, size, "%c", *(char*)(v->ptr));
+        return buf;
 
     case VAR_STR:
-        asprintf(&value, "%s", *(char**)(v->ptr));
-        break;
+        return *(char**)(v->ptr);
 
     default:
-        asprintf(&value, "variable type unhandled");
-        break;
+        return "variable type unhandled";
+    }
+} /* }}} */
+
+char* var_value_message(struct var* v, bool printname) { /* {{{ */
+    /* format a message containing the name and value of a variable */
+    char        buf[TIMELENGTH];
+    char*       message;
+    const char* value;
+
+    value = var_value(v, buf, sizeof(buf));
+
+    if (value == NULL) {
+        value = "(null)";
     }
 
     if (printname == false) {
-        return value;
+        return strdup(value);
     }
 
     message = malloc(strlen(v->name) + strlen(value) + 3);
     strcpy(message, v->name);
     strcat(message, ": ");
     strcat(message, value);
-    free(value);
 
     return message;
 } /* }}} */
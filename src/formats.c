@@ -9,20 +9,70 @@
 #include <stdlib.h>
 #include <string.h>
 #include "common.h"
+#include "config.h"
 #include "formats.h"
+#include "log.h"
 
 /* externs */
 extern struct var vars[];
 extern struct config cfg;
 
+/**
+ * format output struct - the buffer a format is being evaluated into
+ * buf  - the buffer, which is not null terminated while evaluating
+ * size - the size of buf
+ * len  - the length of the output, which is larger than size if it
+ *        did not fit
+ */
+struct fmt_output {
+    char* buf;
+    size_t size;
+    size_t len;
+};
+
 /* local functions */
+static struct fmt_field* add_field(struct format* format, const enum fmt_field_type type);
 static char* append_buffer(char* buffer, const char append, int* bufferlen);
-static void append_field(struct fmt_field** head, struct fmt_field** last, struct fmt_field* this);
-static struct fmt_field* buffer_field(char* buffer, int bufferlen);
-static char* eval_conditional(struct conditional_fmt_field* this, struct task* tsk);
-static char* field_to_str(struct fmt_field* this, bool* free_field, struct task* tsk);
-static void free_format(struct fmt_field* this);
-static struct conditional_fmt_field* parse_conditional(char** str);
+static void buffer_field(struct format* format, char* buffer, int bufferlen);
+static void compile_fields(struct format* format, char* fmt);
+static void find_depends(struct format* format);
+static bool eval_condition(const struct fmt_field* fields, const int nfields, const struct task* tsk);
+static void eval_fields(const struct fmt_field* fields, const int nfields, const struct task* tsk,
+                        struct fmt_output* out);
+static const char* field_value(const struct fmt_field* this, const struct task* tsk, char* buf);
+static void free_format(struct format* this);
+static void output_spaces(struct fmt_output* out, const size_t n);
+static void output_str(struct fmt_output* out, const char* str, const size_t n);
+static bool parse_conditional(struct format* format, char** str);
+
+struct fmt_field* add_field(struct format* format, const enum fmt_field_type type) { /* {{{ */
+    /**
+     * append a field to a format
+     * format - the format to append to
+     * type   - the type of the new field
+     * return is the new field, which is valid until the next field is added,
+     * or NULL if it could not be allocated
+     */
+    struct fmt_field* tmp;
+
+    if (format->nfields >= format->size) {
+        tmp = realloc(format->fields, 2 * (format->size + 4) * sizeof(struct fmt_field));
+
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "critical: failed to allocate format field");
+            return NULL;
+        }
+
+        format->fields = tmp;
+        format->size = 2 * (format->size + 4);
+    }
+
+    tmp = &(format->fields[format->nfields++]);
+    memset(tmp, 0, sizeof(struct fmt_field));
+    tmp->type = type;
+
+    return tmp;
+} /* }}} */
 
 char* append_buffer(char* buffer, const char append, int* bufferlen) { /* {{{ */
     /**
@@ -39,46 +89,22 @@ char* append_buffer(char* buffer, const char append, int* bufferlen) { /* {{{ */
     return buffer;
 } /* }}} */
 
-void append_field(struct fmt_field** head, struct fmt_field** last,
-                  struct fmt_field* this) { /* {{{ */
-    /**
-     * append a format field to a linked list of format fields
-     * head      - the first format field
-     * last      - the last format field
-     * this      - the format field to append
-     */
-    if (*head == NULL) {
-        *head = this;
-    } else {
-        (*last)->next = this;
-    }
-
-    *last = this;
-} /* }}} */
+void buffer_field(struct format* format, char* buffer, int bufferlen) { /* {{{ */
+    /* append a string field to a format from a buffer string of a specified length */
+    struct fmt_field* this = add_field(format, FIELD_STRING);
 
-struct fmt_field* buffer_field(char* buffer, int bufferlen) { /* {{{ */
-    /* create a format struct from a buffer string of a specified length */
-    struct fmt_field* this;
+    if (this == NULL) {
+        free(buffer);
+        return;
+    }
 
-    this = calloc(1, sizeof(struct fmt_field));
     this->field = buffer;
     this->length = bufferlen;
-    this->width = bufferlen;
-    this->type = FIELD_STRING;
-
-    return this;
-} /* }}} */
-
-void compile_formats() { /* {{{ */
-    /* compile all the format strings */
-    cfg.formats.task_compiled = compile_format_string(cfg.formats.task);
-    cfg.formats.title_compiled = compile_format_string(cfg.formats.title);
-    cfg.formats.view_compiled = compile_format_string(cfg.formats.view);
 } /* }}} */
 
-struct fmt_field* compile_format_string(char* fmt) { /* {{{ */
-    /* compile a given format string */
-    struct fmt_field* head = NULL, *this, *last = NULL;
+void compile_fields(struct format* format, char* fmt) { /* {{{ */
+    /* compile a given format string, appending its fields to a format */
+    struct fmt_field* this;
     int buffersize = 0, i, width;
     char* buffer = NULL;
     bool next, right_align;
@@ -93,7 +119,7 @@ struct fmt_field* compile_format_string(char* fmt) { /* {{{ */
 
     /* check for an empty format string */
     if (fmt == NULL) {
-        return NULL;
+        return;
     }
 
     /* iterate through format string */
@@ -108,20 +134,14 @@ struct fmt_field* compile_format_string(char* fmt) { /* {{{ */
         else {
             /* make existing buffer a field */
             if (buffer != NULL) {
-                this = buffer_field(buffer, buffersize);
+                buffer_field(format, buffer, buffersize);
                 buffer = NULL;
                 buffersize = 0;
-                append_field(&head, &last, this);
             }
 
             /* check for conditional */
             if (*fmt == '?') {
-                this = calloc(1, sizeof(struct fmt_field));
-                this->type = FIELD_CONDITIONAL;
-                this->conditional = parse_conditional(&fmt);
-                append_field(&head, &last, this);
-
-                if (this->conditional == NULL) {
+                if (!parse_conditional(format, &fmt)) {
                     buffer = append_buffer(buffer, *fmt, &buffersize);
                     fmt++;
                 }
@@ -146,60 +166,53 @@ struct fmt_field* compile_format_string(char* fmt) { /* {{{ */
 
             /* check for date */
             if (str_starts_with(fmt, "date")) {
-                this = calloc(1, sizeof(struct fmt_field));
-                this->type = FIELD_DATE;
-                this->width = width;
-                this->right_align = right_align;
-                append_field(&head, &last, this);
+                this = add_field(format, FIELD_DATE);
                 fmt += 4;
-                continue;
             }
-
             /* check for time */
-            if (str_starts_with(fmt, "time")) {
-                this = calloc(1, sizeof(struct fmt_field));
-                this->type = FIELD_TIME;
+            else if (str_starts_with(fmt, "time")) {
+                this = add_field(format, FIELD_TIME);
+                fmt += 4;
+            } else {
+                this = NULL;
+            }
+
+            if (this != NULL) {
                 this->width = width;
                 this->right_align = right_align;
-                append_field(&head, &last, this);
-                fmt += 4;
                 continue;
             }
 
             /* check for task field */
             for (i = FIELD_PROJECT; i <= FIELD_INDEX; i++) {
                 if (str_starts_with(fmt, task_field_map[i])) {
-                    this = calloc(1, sizeof(struct fmt_field));
-                    this->type = i;
-                    this->width = width;
-                    this->right_align = right_align;
-                    append_field(&head, &last, this);
+                    this = add_field(format, i);
                     fmt += strlen(task_field_map[i]);
                     next = true;
                     break;
                 }
             }
 
-            if (next) {
-                continue;
-            }
-
             /* check for a var */
-            for (i = 0; vars[i].name != NULL; i++) {
+            for (i = 0; !next && vars[i].name != NULL; i++) {
                 if (str_starts_with(fmt, vars[i].name)) {
-                    this = calloc(1, sizeof(struct fmt_field));
-                    this->width = width;
-                    this->right_align = right_align;
-                    this->type = FIELD_VAR;
-                    this->variable = &(vars[i]);
-                    append_field(&head, &last, this);
+                    this = add_field(format, FIELD_VAR);
+
+                    if (this != NULL) {
+                        this->variable = &(vars[i]);
+                    }
+
                     fmt += strlen(vars[i].name);
                     next = true;
-                    break;
                 }
             }
 
             if (next) {
+                if (this != NULL) {
+                    this->width = width;
+                    this->right_align = right_align;
+                }
+
                 continue;
             }
 
@@ -213,225 +226,328 @@ struct fmt_field* compile_format_string(char* fmt) { /* {{{ */
 
     /* handle a pending buffer */
     if (buffer != NULL) {
-        this = buffer_field(buffer, buffersize);
-        buffer = NULL;
-        buffersize = 0;
-        append_field(&head, &last, this);
+        buffer_field(format, buffer, buffersize);
     }
+} /* }}} */
 
-    return head;
+void compile_formats() { /* {{{ */
+    /* compile all the format strings */
+    cfg.formats.task_compiled = compile_format_string(cfg.formats.task);
+    cfg.formats.title_compiled = compile_format_string(cfg.formats.title);
+    cfg.formats.view_compiled = compile_format_string(cfg.formats.view);
 } /* }}} */
 
-static char* eval_conditional(struct conditional_fmt_field* this,
-                              struct task* tsk) { /* {{{ */
+struct format* compile_format_string(char* fmt) { /* {{{ */
     /**
-     * evaluate a conditional struct to a string
-     * this - the conditional struct
-     * tsk  - the task to evaluate the struct on
+     * compile a given format string
+     * fmt - the format string
+     * return is the compiled format, or NULL if fmt is NULL
      */
-    char* tmp = NULL, *ret = NULL;
+    struct format* this;
 
-    /* handle empty conditionals */
-    if (this == NULL) {
-        ret = calloc(1, sizeof(char));
-        *ret = 0;
-        return ret;
+    if (fmt == NULL) {
+        return NULL;
     }
 
-    /* evaluate conditional */
-    tmp = eval_format(this->condition, tsk);
+    this = calloc(1, sizeof(struct format));
 
-    /* check if conditional was "(null)" */
-    if (str_eq(tmp, "(null)")) {
-        *tmp = 0;
+    if (this != NULL) {
+        compile_fields(this, fmt);
+        find_depends(this);
     }
 
-    /* check first char of evaluated format at determine
-     * whether the positive or negative condition should
-     * be returned
+    return this;
+} /* }}} */
+
+bool eval_condition(const struct fmt_field* fields, const int nfields,
+                    const struct task* tsk) { /* {{{ */
+    /**
+     * evaluate the condition of a conditional
+     * fields  - the fields of the condition
+     * nfields - the number of fields
+     * tsk     - the task to evaluate the condition on
+     * return is false if the condition is empty, "(null)" or starts with
+     * '0' or ' ', and true otherwise
      */
-    switch (*tmp) {
-    case 0:
-    case '0':
-    case ' ':
-        ret = eval_format(this->negative, tsk);
-        break;
+    char                buf[8];
+    struct fmt_output   out = {buf, sizeof(buf), 0};
 
-    default:
-        ret = eval_format(this->positive, tsk);
-        break;
-    }
+    /* only the start of the condition matters, so the rest is not kept */
+    eval_fields(fields, nfields, tsk, &out);
 
-    free(tmp);
+    if (out.len == 0 || (out.len == 6 && memcmp(buf, "(null)", 6) == 0)) {
+        return false;
+    }
 
-    return ret;
+    return buf[0] != '0' && buf[0] != ' ';
 } /* }}} */
 
-char* eval_format(struct fmt_field* fmts, struct task* tsk) { /* {{{ */
+void eval_fields(const struct fmt_field* fields, const int nfields,
+                 const struct task* tsk, struct fmt_output* out) { /* {{{ */
     /**
-     * evaluate a linked list of format fields
-     * fmts - the first element in the linked list of format fields
-     * tsk  - the task to evaluate the format on
+     * evaluate a run of format fields
+     * fields  - the first field
+     * nfields - the number of fields
+     * tsk     - the task to evaluate the fields on
+     * out     - the output to append to
      */
-    int totallen = 1, pos = 0;
-    unsigned int fieldwidth, fieldlen, p;
-    char* str = NULL, *tmp;
-    struct fmt_field* this;
-    bool free_tmp;
-
-    /* build string */
-    for (this = fmts; this != NULL; this = this->next) {
-        tmp = NULL;
+    const struct fmt_field* this;
+    const char*             value;
+    char                    buf[TIMELENGTH];
+    unsigned int            width;
+    unsigned int            len;
+    size_t                  bytes;
+    int                     i;
+
+    for (i = 0; i < nfields; i++) {
+        this = &fields[i];
+
+        /* print one branch of a conditional and skip over the rest */
+        if (this->type == FIELD_CONDITIONAL) {
+            if (eval_condition(this + 1, this->condition, tsk)) {
+                eval_fields(this + 1 + this->condition, this->positive, tsk, out);
+            } else {
+                eval_fields(this + 1 + this->condition + this->positive, this->negative, tsk, out);
+            }
 
-        /* convert field to string */
-        tmp = field_to_str(this, &free_tmp, tsk);
+            i += this->condition + this->positive + this->negative;
+            continue;
+        }
 
-        /* handle field string */
-        if (tmp == NULL) {
+        if (this->type == FIELD_STRING) {
+            output_str(out, this->field, this->length);
             continue;
         }
 
-        /* get string data */
-        fieldlen = strlen(tmp);
+        value = field_value(this, tsk, buf);
 
+        if (value == NULL) {
+            continue;
+        }
+
+        /* get the width of the field */
         if (this->type == FIELD_PROJECT && this->width == 0) {
-            fieldwidth = cfg.fieldlengths.project;
+            width = cfg.fieldlengths.project;
+        } else if (this->width == 0) {
+            output_str(out, value, strlen(value));
+            continue;
         } else {
-            fieldwidth = this->width > 0 ? this->width : fieldlen;
+            width = this->width;
         }
 
-        /* realloc string */
-        totallen += fieldwidth;
-        str = realloc(str, totallen * sizeof(char));
-        str[totallen - 1] = 0;
+        /* pad or cut the field to its width */
+        len = str_width(value, width, &bytes);
 
-        /* buffer right-aligned string */
         if (this->right_align) {
-            for (p = 0; p < fieldwidth - fieldlen; p++) {
-                *(str + pos + p) = ' ';
-            }
-
-            pos += fieldwidth - fieldlen;
+            output_spaces(out, width - len);
         }
 
-        /* copy string */
-        strncpy(str + pos, tmp, MIN(fieldwidth, fieldlen));
+        output_str(out, value, bytes);
 
-        if (free_tmp) {
-            free(tmp);
+        if (!(this->right_align)) {
+            output_spaces(out, width - len);
         }
+    }
+} /* }}} */
 
-        /* buffer left-aligned string */
-        if (!(this->right_align)) {
-            for (p = fieldlen; p < fieldwidth; p++) {
-                *(str + pos + p) = ' ';
-            }
+char* eval_format(const struct format* fmt, const struct task* tsk, char** buf,
+                  size_t* size) { /* {{{ */
+    /**
+     * evaluate a compiled format
+     * fmt  - the format
+     * tsk  - the task to evaluate the format on
+     * buf  - the buffer to store the result in, which is grown if it is
+     *        too small
+     * size - the size of buf (will be updated)
+     * return is the buffer, or NULL if fmt is NULL or buf could not be grown
+     */
+    struct fmt_output   out;
+    char*               tmp;
+
+    if (fmt == NULL) {
+        return NULL;
+    }
+
+    out.buf = *buf;
+    out.size = *size;
+    out.len = 0;
+    eval_fields(fmt->fields, fmt->nfields, tsk, &out);
+
+    /* evaluate again if the result did not fit */
+    if (out.len >= *size) {
+        tmp = realloc(*buf, out.len + 1);
+
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "critical: failed to allocate format buffer");
+            return NULL;
         }
 
-        /* move current position */
-        pos += this->right_align ? fieldlen : fieldwidth;
+        *buf = tmp;
+        *size = out.len + 1;
+        out.buf = tmp;
+        out.size = *size;
+        out.len = 0;
+        eval_fields(fmt->fields, fmt->nfields, tsk, &out);
     }
 
-    return str;
+    (*buf)[MIN(out.len, *size - 1)] = 0;
+
+    return *buf;
 } /* }}} */
 
-static char* field_to_str(struct fmt_field* this, bool* free_field,
-                          struct task* tsk) { /* {{{ */
+const char* field_value(const struct fmt_field* this, const struct task* tsk,
+                        char* buf) { /* {{{ */
     /**
-     * evaluate a field and convert it to a string
-     * this       - the field to be evaluated
-     * free_field - whether the field needs to be free'd after use
-     * tsk        - the task to evaluate the format on
+     * get the string a field prints
+     * this - the field to be evaluated
+     * tsk  - the task to evaluate the field on
+     * buf  - where dates and numbers will be formatted, TIMELENGTH bytes long
+     * return is the string, or NULL if the field prints nothing
      */
-    char* ret = NULL;
-    *free_field = true;
+    const char* value;
 
-    switch (this->type) {
-    case FIELD_STRING:
-        ret = this->field;
-        *free_field = false;
-        break;
+    /* a format evaluated without a task prints no task fields */
+    if (tsk == NULL && this->type >= FIELD_PROJECT && this->type <= FIELD_INDEX) {
+        return NULL;
+    }
 
+    switch (this->type) {
     case FIELD_DATE:
-        ret = utc_date(0);
-        break;
+        return utc_date(buf, 0);
 
     case FIELD_TIME:
-        ret = utc_time(0);
-        break;
+        return utc_time(buf, 0);
 
     case FIELD_VAR:
-        ret = var_value_message(this->variable, false);
-        break;
+        value = var_value(this->variable, buf, TIMELENGTH);
+        return value != NULL ? value : "(null)";
 
     case FIELD_PROJECT:
-        ret = tsk->project;
-        *free_field = false;
-        break;
+        return tsk->project;
 
     case FIELD_DESCRIPTION:
-        ret = tsk->description;
-        *free_field = false;
-        break;
+        return tsk->description;
 
     case FIELD_DUE:
-        if (tsk->due) {
-            ret = utc_date(tsk->due);
-        } else {
-            ret = strdup(" ");
-        }
-
-        break;
+        return tsk->due ? utc_date(buf, tsk->due) : " ";
 
     case FIELD_PRIORITY:
-        if (tsk->priority) {
-            ret = calloc(2, sizeof(char));
-            *ret = tsk->priority;
+        if (tsk->priority == 0) {
+            return NULL;
         }
 
-        break;
+        buf[0] = tsk->priority;
+        buf[1] = 0;
+
+        return buf;
 
     case FIELD_UUID:
-        ret = tsk->uuid;
-        *free_field = false;
-        break;
+        return tsk->uuid;
 
     case FIELD_INDEX:
-        asprintf(&ret , "%d", tsk->index);
-        break;
-
-    case FIELD_CONDITIONAL:
-        ret = eval_conditional(this->conditional, tsk);
-        break;
+        snprintf(buf, TIMELENGTH, "%d", tsk->index);
+        return buf;
 
     default:
-        break;
+        return NULL;
     }
+} /* }}} */
+
+void find_depends(struct format* format) { /* {{{ */
+    /* find the variables and clock fields a format prints */
+    struct fmt_field*   this;
+    int                 i;
+    int                 j;
 
-    return ret;
+    format->depends = calloc(format->nfields + 1, sizeof(struct var*));
+    format->values = calloc(format->nfields + 1, sizeof(char*));
+    format->minute = -1;
+
+    for (i = 0; i < format->nfields; i++) {
+        this = &(format->fields[i]);
+
+        if (this->type == FIELD_DATE || this->type == FIELD_TIME) {
+            format->clock = true;
+        }
+
+        if (this->type != FIELD_VAR || format->depends == NULL || format->values == NULL) {
+            continue;
+        }
+
+        for (j = 0; j < format->ndepends && format->depends[j] != this->variable; j++);
+
+        if (j == format->ndepends) {
+            format->depends[format->ndepends++] = this->variable;
+        }
+    }
 } /* }}} */
 
-void free_format(struct fmt_field* this) { /* {{{ */
-    /* walk through a format list and free its elements */
-    struct fmt_field* last;
+bool format_changed(struct format* fmt) { /* {{{ */
+    /**
+     * check whether a format could evaluate differently than when this was
+     * last called for it, not counting changes to the task it is evaluated on
+     * fmt - the format to check
+     * return is whether a variable it prints or the clock changed
+     */
+    const char* value;
+    char        buf[TIMELENGTH];
+    bool        changed = false;
+    time_t      minute;
+    int         i;
+
+    if (fmt == NULL) {
+        return false;
+    }
 
-    while (this != NULL) {
-        last = this;
-        this = this->next;
+    /* dates and times are shown no finer than minutes */
+    if (fmt->clock) {
+        minute = time(NULL) / 60;
 
-        if (last->type == FIELD_STRING) {
-            free(last->field);
+        if (minute != fmt->minute) {
+            fmt->minute = minute;
+            changed = true;
         }
+    }
+
+    /* compare each variable with the copy of its last value */
+    for (i = 0; i < fmt->ndepends; i++) {
+        value = var_value(fmt->depends[i], buf, sizeof(buf));
 
-        if (last->type == FIELD_CONDITIONAL && last->conditional != NULL) {
-            free_format(last->conditional->condition);
-            free_format(last->conditional->positive);
-            free_format(last->conditional->negative);
-            free(last->conditional);
+        if (value == NULL ? fmt->values[i] == NULL :
+            fmt->values[i] != NULL && str_eq(value, fmt->values[i])) {
+            continue;
         }
 
-        free(last);
+        free(fmt->values[i]);
+        fmt->values[i] = value != NULL ? strdup(value) : NULL;
+        changed = true;
     }
+
+    return changed;
+} /* }}} */
+
+void free_format(struct format* this) { /* {{{ */
+    /* free a compiled format and its strings */
+    int i;
+
+    if (this == NULL) {
+        return;
+    }
+
+    for (i = 0; i < this->nfields; i++) {
+        if (this->fields[i].type == FIELD_STRING) {
+            free(this->fields[i].field);
+        }
+    }
+
+    for (i = 0; i < this->ndepends; i++) {
+        free(this->values[i]);
+    }
+
+    free(this->fields);
+    free(this->depends);
+    free(this->values);
+    free(this);
 } /* }}} */
 
 void free_formats() { /* {{{ */
@@ -441,11 +557,34 @@ void free_formats() { /* {{{ */
     free_format(cfg.formats.task_compiled);
 } /* }}} */
 
-struct conditional_fmt_field* parse_conditional(char** str) { /* {{{ */
-    /* parse a conditional struct from a string at a position */
-    struct conditional_fmt_field* this = calloc(1, sizeof(struct conditional_fmt_field));
+void output_spaces(struct fmt_output* out, const size_t n) { /* {{{ */
+    /* append spaces to a format output, keeping what fits in its buffer */
+    if (out->len < out->size) {
+        memset(out->buf + out->len, ' ', MIN(n, out->size - out->len));
+    }
+
+    out->len += n;
+} /* }}} */
+
+void output_str(struct fmt_output* out, const char* str, const size_t n) { /* {{{ */
+    /* append a string to a format output, keeping what fits in its buffer */
+    if (out->len < out->size) {
+        memcpy(out->buf + out->len, str, MIN(n, out->size - out->len));
+    }
+
+    out->len += n;
+} /* }}} */
+
+bool parse_conditional(struct format* format, char** str) { /* {{{ */
+    /**
+     * parse a conditional from a string at a position, appending it to a format
+     * format - the format to append to
+     * str    - the position in the string (will be moved past the conditional)
+     * return is whether a conditional was found
+     */
     char* condition = NULL, *positive = NULL, *negative = NULL;
-    int ret, addlen = 0;
+    int ret, addlen = 0, pos, start;
+    bool found = true;
 
     /* look for positive and negative */
     ret = sscanf(*str, "?%m[^?]?%m[^?]?%m[^?]?", &condition, &positive, &negative);
@@ -468,15 +607,27 @@ struct conditional_fmt_field* parse_conditional(char** str) { /* {{{ */
         goto parse;
     }
 
-    check_free(this);
-    this = NULL;
+    found = false;
     goto done;
 
 parse:
-    /* compile each field */
-    this->condition = compile_format_string(condition);
-    this->positive = compile_format_string(positive);
-    this->negative = compile_format_string(negative);
+    /* compile each part after the conditional field */
+    pos = format->nfields;
+
+    if (add_field(format, FIELD_CONDITIONAL) == NULL) {
+        found = false;
+        goto done;
+    }
+
+    start = format->nfields;
+    compile_fields(format, condition);
+    format->fields[pos].condition = format->nfields - start;
+    start = format->nfields;
+    compile_fields(format, positive);
+    format->fields[pos].positive = format->nfields - start;
+    start = format->nfields;
+    compile_fields(format, negative);
+    format->fields[pos].negative = format->nfields - start;
 
     /* move position of string */
     if (condition != NULL) {
@@ -501,7 +652,7 @@ done:
     check_free(positive);
     check_free(negative);
 
-    return this;
+    return found;
 } /* }}} */
 
 // vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,465 @@
+/*
+ * json.c - single pass json tokenizer
+ * for tasknc
+ * by mjheagle
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+/* local functions */
+static bool decode_string(struct json_parser* p, const char* start, const char** str, size_t* len);
+static int hex_value(const char* pos);
+static bool reserve_buffer(struct json_parser* p, const size_t len);
+static void skip_whitespace(struct json_parser* p);
+static size_t utf8_encode(char* out, unsigned long cp);
+
+bool decode_string(struct json_parser* p, const char* start,
+                   const char** str, size_t* len) { /* {{{ */
+    /**
+     * decode the remainder of a string containing escapes into the scratch buffer
+     * p     - the parser, positioned at the first backslash in the string
+     * start - the first character of the string contents
+     * str   - where a pointer to the decoded string will be stored
+     * len   - where the length of the decoded string will be stored
+     * return is whether the string was terminated and well formed
+     */
+    size_t          out = p->pos - start;
+    unsigned long   cp;
+    int             hex;
+
+    if (!reserve_buffer(p, out + 8)) {
+        return false;
+    }
+
+    memcpy(p->buf, start, out);
+
+    while (p->pos < p->end && *p->pos != '"') {
+        if (!reserve_buffer(p, out + 8)) {
+            return false;
+        }
+
+        /* plain character */
+        if (*p->pos != '\\') {
+            p->buf[out++] = *(p->pos++);
+            continue;
+        }
+
+        /* escape sequence */
+        p->pos++;
+
+        if (p->pos >= p->end) {
+            return false;
+        }
+
+        switch (*p->pos) {
+        case 'b':
+            p->buf[out++] = '\b';
+            break;
+
+        case 'f':
+            p->buf[out++] = '\f';
+            break;
+
+        case 'n':
+            p->buf[out++] = '\n';
+            break;
+
+        case 'r':
+            p->buf[out++] = '\r';
+            break;
+
+        case 't':
+            p->buf[out++] = '\t';
+            break;
+
+        case 'u':
+            if (p->end - p->pos < 5 || (hex = hex_value(p->pos + 1)) < 0) {
+                return false;
+            }
+
+            cp = hex;
+            p->pos += 4;
+
+            /* combine utf-16 surrogate pairs */
+            if (cp >= 0xd800 && cp <= 0xdbff) {
+                if (p->end - p->pos >= 7 && p->pos[1] == '\\' && p->pos[2] == 'u' &&
+                    (hex = hex_value(p->pos + 3)) >= 0xdc00 && hex <= 0xdfff) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (hex - 0xdc00);
+                    p->pos += 6;
+                } else {
+                    cp = 0xfffd;
+                }
+            } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+                cp = 0xfffd;
+            }
+
+            out += utf8_encode(p->buf + out, cp);
+            break;
+
+        default:
+            /* \" \\ \/ and anything unknown map to the escaped character */
+            p->buf[out++] = *p->pos;
+            break;
+        }
+
+        p->pos++;
+    }
+
+    if (p->pos >= p->end) {
+        return false;
+    }
+
+    p->pos++;
+    p->buf[out] = 0;
+    *str = p->buf;
+    *len = out;
+
+    return true;
+} /* }}} */
+
+int hex_value(const char* pos) { /* {{{ */
+    /* parse four hexadecimal digits, returning -1 if they are malformed */
+    int value = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        value <<= 4;
+
+        if (pos[i] >= '0' && pos[i] <= '9') {
+            value |= pos[i] - '0';
+        } else if (pos[i] >= 'a' && pos[i] <= 'f') {
+            value |= pos[i] - 'a' + 10;
+        } else if (pos[i] >= 'A' && pos[i] <= 'F') {
+            value |= pos[i] - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+
+    return value;
+} /* }}} */
+
+bool json_array_begin(struct json_parser* p) { /* {{{ */
+    /* consume the opening bracket of an array */
+    skip_whitespace(p);
+
+    if (p->pos >= p->end || *p->pos != '[') {
+        return false;
+    }
+
+    p->pos++;
+    return true;
+} /* }}} */
+
+int json_array_next(struct json_parser* p) { /* {{{ */
+    /**
+     * advance to the next element of an array
+     * return is 1 if an element follows, 0 at the end of the array
+     * or -1 if the input ended early
+     */
+    skip_whitespace(p);
+
+    if (p->pos >= p->end) {
+        return -1;
+    }
+
+    if (*p->pos == ']') {
+        p->pos++;
+        return 0;
+    }
+
+    if (*p->pos == ',') {
+        p->pos++;
+        skip_whitespace(p);
+    }
+
+    return 1;
+} /* }}} */
+
+void json_free(struct json_parser* p) { /* {{{ */
+    /* free the scratch buffer of a parser */
+    free(p->buf);
+    p->buf = NULL;
+    p->buflen = 0;
+} /* }}} */
+
+void json_init(struct json_parser* p, const char* str, const size_t len) { /* {{{ */
+    /**
+     * point a parser at a new document, keeping its scratch buffer
+     * p   - the parser to be initialized
+     * str - the json document
+     * len - the length of the document
+     */
+    p->pos = str;
+    p->end = str + len;
+} /* }}} */
+
+bool json_int(struct json_parser* p, long* value) { /* {{{ */
+    /* parse an integer, discarding any fraction or exponent */
+    bool negative = false;
+    long ret = 0;
+
+    skip_whitespace(p);
+
+    if (p->pos < p->end && *p->pos == '-') {
+        negative = true;
+        p->pos++;
+    }
+
+    if (p->pos >= p->end || *p->pos < '0' || *p->pos > '9') {
+        return false;
+    }
+
+    while (p->pos < p->end && *p->pos >= '0' && *p->pos <= '9') {
+        ret = 10 * ret + (*(p->pos++) - '0');
+    }
+
+    while (p->pos < p->end && strchr(".eE+-0123456789", *p->pos) != NULL) {
+        p->pos++;
+    }
+
+    *value = negative ? -ret : ret;
+    return true;
+} /* }}} */
+
+int json_next_member(struct json_parser* p, const char** key,
+                     size_t* keylen) { /* {{{ */
+    /**
+     * read the key of the next member of an object and consume the colon
+     * key    - where a pointer to the key will be stored
+     * keylen - where the length of the key will be stored
+     * return is 1 if a member follows, 0 at the end of the object
+     * or -1 if the input is malformed
+     * the key remains valid until the next string is read
+     */
+    skip_whitespace(p);
+
+    if (p->pos >= p->end) {
+        return -1;
+    }
+
+    if (*p->pos == '}') {
+        p->pos++;
+        return 0;
+    }
+
+    if (*p->pos == ',') {
+        p->pos++;
+    }
+
+    if (!json_string(p, key, keylen)) {
+        return -1;
+    }
+
+    skip_whitespace(p);
+
+    if (p->pos >= p->end || *p->pos != ':') {
+        return -1;
+    }
+
+    p->pos++;
+    return 1;
+} /* }}} */
+
+bool json_object_begin(struct json_parser* p) { /* {{{ */
+    /* consume the opening brace of an object */
+    skip_whitespace(p);
+
+    if (p->pos >= p->end || *p->pos != '{') {
+        return false;
+    }
+
+    p->pos++;
+    return true;
+} /* }}} */
+
+enum json_type json_peek(struct json_parser* p) { /* {{{ */
+    /* determine the type of the next value without consuming it */
+    skip_whitespace(p);
+
+    if (p->pos >= p->end) {
+        return JSON_NONE;
+    }
+
+    switch (*p->pos) {
+    case '"':
+        return JSON_STRING;
+
+    case '[':
+        return JSON_ARRAY;
+
+    case '{':
+        return JSON_OBJECT;
+
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        return JSON_NUMBER;
+
+    default:
+        return JSON_LITERAL;
+    }
+} /* }}} */
+
+bool json_skip(struct json_parser* p) { /* {{{ */
+    /* skip over the next value, including any nested values */
+    int depth = 0;
+
+    do {
+        skip_whitespace(p);
+
+        if (p->pos >= p->end) {
+            return false;
+        }
+
+        switch (*p->pos) {
+        case '"':
+            p->pos++;
+
+            while (p->pos < p->end && *p->pos != '"') {
+                p->pos += *p->pos == '\\' ? 2 : 1;
+            }
+
+            if (p->pos >= p->end) {
+                return false;
+            }
+
+            p->pos++;
+            break;
+
+        case '[':
+        case '{':
+            depth++;
+            p->pos++;
+            break;
+
+        case ']':
+        case '}':
+            depth--;
+            p->pos++;
+            break;
+
+        case ',':
+        case ':':
+            p->pos++;
+            break;
+
+        default:
+            while (p->pos < p->end && strchr(",:]} \t\r\n", *p->pos) == NULL) {
+                p->pos++;
+            }
+
+            break;
+        }
+    } while (depth > 0);
+
+    return depth == 0;
+} /* }}} */
+
+bool json_string(struct json_parser* p, const char** str, size_t* len) { /* {{{ */
+    /**
+     * read a string value
+     * str - where a pointer to the string contents will be stored
+     * len - where the length of the string contents will be stored
+     * strings without escapes point into the document and are not terminated,
+     * decoded strings live in the scratch buffer until the next string is read
+     */
+    const char* start;
+
+    skip_whitespace(p);
+
+    if (p->pos >= p->end || *p->pos != '"') {
+        return false;
+    }
+
+    start = ++(p->pos);
+
+    /* fast path: scan for the closing quote */
+    while (p->pos < p->end && *p->pos != '"' && *p->pos != '\\') {
+        p->pos++;
+    }
+
+    if (p->pos >= p->end) {
+        return false;
+    }
+
+    if (*p->pos == '\\') {
+        return decode_string(p, start, str, len);
+    }
+
+    *str = start;
+    *len = p->pos - start;
+    p->pos++;
+
+    return true;
+} /* }}} */
+
+bool reserve_buffer(struct json_parser* p, const size_t len) { /* {{{ */
+    /* make sure the scratch buffer can hold len bytes */
+    char*  tmp;
+    size_t newlen;
+
+    if (len <= p->buflen) {
+        return true;
+    }
+
+    newlen = p->buflen > 0 ? p->buflen : 256;
+
+    while (newlen < len) {
+        newlen *= 2;
+    }
+
+    tmp = realloc(p->buf, newlen);
+
+    if (tmp == NULL) {
+        return false;
+    }
+
+    p->buf = tmp;
+    p->buflen = newlen;
+
+    return true;
+} /* }}} */
+
+void skip_whitespace(struct json_parser* p) { /* {{{ */
+    /* move past any insignificant whitespace */
+    while (p->pos < p->end && (*p->pos == ' ' || *p->pos == '\t' ||
+                               *p->pos == '\n' || *p->pos == '\r')) {
+        p->pos++;
+    }
+} /* }}} */
+
+size_t utf8_encode(char* out, unsigned long cp) { /* {{{ */
+    /* write a code point as utf-8, returning the number of bytes used */
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xc0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xe0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+
+    out[0] = 0xf0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3f);
+    out[2] = 0x80 | ((cp >> 6) & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,201 @@
+/*
+ * loader.c - read task export output without blocking
+ * for tasknc
+ * by mjheagle
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "loader.h"
+#include "log.h"
+#include "tasks.h"
+
+/* minimum free space in the read buffer before each read */
+#define LOADER_READ_SIZE                (64 << 10)
+
+/* local functions */
+static void loader_line(struct task_loader* l, const char* line, const size_t len);
+
+struct task* loader_close(struct task_loader* l) { /* {{{ */
+    /**
+     * finish an export, closing the pipe and releasing the read buffer
+     * l - the loader to close
+     * return is the list of tasks parsed and not yet taken
+     */
+    pclose(l->cmd);
+    free(l->buf);
+    json_free(&(l->json));
+    l->cmd = NULL;
+    l->buf = NULL;
+    l->fd = -1;
+
+    /* log parse throughput */
+    tnc_fprintf(logfp, LOG_DEBUG, "parsed %d tasks (%lu bytes) in %.3f ms (%.2f MB/s)",
+                l->count, (unsigned long)l->bytes, l->parsetime * 1e3,
+                l->parsetime > 0 ? l->bytes / l->parsetime / 1e6 : 0);
+
+    return loader_take(l);
+} /* }}} */
+
+void loader_line(struct task_loader* l, const char* line,
+                 const size_t len) { /* {{{ */
+    /**
+     * parse one line of export output and append it to the loaded tasks
+     * l    - the loader the line was read by
+     * line - the line, which is not null terminated
+     * len  - the length of the line
+     */
+    struct task*    this;
+    struct timespec t0;
+    struct timespec t1;
+
+    /* log line */
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "%.*s", (int)len, line);
+
+    /* parse line */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    json_init(&(l->json), line, len);
+    this = parse_task(&(l->json), l->arena);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    l->parsetime += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    l->bytes += len;
+
+    if (this == NULL) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not allocate task");
+        return;
+    } else if (this == (struct task*) - 1) {
+        return;
+    } else if (this->uuid == NULL || this->description == NULL) {
+        tnc_fprintf(logfp, LOG_ERROR, "task without uuid or description: %.*s",
+                    (int)len, line);
+        return;
+    }
+
+    if (this->modified > l->modified) {
+        l->modified = this->modified;
+    }
+
+    /* set pointers */
+    this->prev = l->last;
+
+    if (l->last == NULL) {
+        l->head = this;
+    } else {
+        l->last->next = this;
+    }
+
+    l->last = this;
+    l->count++;
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "uuid:        %s", this->uuid);
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "description: %s", this->description);
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "project:     %s", this->project);
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "tags:        %s", this->tags);
+} /* }}} */
+
+bool loader_open(struct task_loader* l, const char* cmdstr,
+                 struct arena* arena, const bool nonblock) { /* {{{ */
+    /**
+     * start an export command
+     * l        - the loader to initialize
+     * cmdstr   - the command to run
+     * arena    - the arena tasks will be allocated from
+     * nonblock - whether reads should return instead of waiting for output
+     * return is whether the command could be run
+     */
+    memset(l, 0, sizeof(struct task_loader));
+    l->arena = arena;
+    l->fd = -1;
+
+    tnc_fprintf(logfp, LOG_DEBUG, "reloading tasks (%s)", cmdstr);
+    l->cmd = popen(cmdstr, "r");
+
+    if (l->cmd == NULL) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not execute command: (%s)", cmdstr);
+        tnc_fprintf(stdout, LOG_ERROR, "could not execute command: (%s)", cmdstr);
+        return false;
+    }
+
+    l->fd = fileno(l->cmd);
+
+    if (nonblock) {
+        fcntl(l->fd, F_SETFL, fcntl(l->fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    return true;
+} /* }}} */
+
+bool loader_read(struct task_loader* l) { /* {{{ */
+    /**
+     * read the output that is available and parse every complete line
+     * l - the loader to read from
+     * return is false once the export has finished
+     */
+    char*   tmp;
+    char*   line;
+    char*   eol;
+    ssize_t n;
+
+    /* make room for the next read */
+    if (l->bufsize - l->buflen < LOADER_READ_SIZE) {
+        tmp = realloc(l->buf, l->buflen + 2 * LOADER_READ_SIZE);
+
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "could not allocate export buffer");
+            return false;
+        }
+
+        l->buf = tmp;
+        l->bufsize = l->buflen + 2 * LOADER_READ_SIZE;
+    }
+
+    n = read(l->fd, l->buf + l->buflen, l->bufsize - l->buflen);
+
+    if (n < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+
+    /* parse a trailing line without a newline at the end of output */
+    if (n == 0) {
+        if (l->buflen > 0) {
+            loader_line(l, l->buf, l->buflen);
+            l->buflen = 0;
+        }
+
+        return false;
+    }
+
+    l->buflen += n;
+
+    /* parse complete lines, keeping any partial line for the next read */
+    line = l->buf;
+
+    while ((eol = memchr(line, '\n', l->buf + l->buflen - line)) != NULL) {
+        loader_line(l, line, eol - line + 1);
+        line = eol + 1;
+    }
+
+    l->buflen -= line - l->buf;
+    memmove(l->buf, line, l->buflen);
+
+    return true;
+} /* }}} */
+
+struct task* loader_take(struct task_loader* l) { /* {{{ */
+    /**
+     * take the tasks parsed so far from a loader
+     * l - the loader to take tasks from
+     * return is the first task taken, later tasks are linked from it
+     */
+    struct task* ret = l->head;
+
+    l->head = NULL;
+    l->last = NULL;
+
+    return ret;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
@@ -28,7 +28,7 @@ void tnc_fprintf(FILE* fp,
     char        timestr[timesize];
 
     /* determine if msg should be logged */
-    if (minloglvl > cfg.loglvl) {
+    if (fp == NULL || minloglvl > cfg.loglvl) {
         return;
     }
 
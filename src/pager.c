@@ -301,7 +301,7 @@ void pager_window(struct line* head,
         while (tmp != NULL && lineno <= linecount && lineno - offset <= height) {
             if (lineno > offset) {
                 mvwhline(pager, lineno - offset, 0, ' ', cols);
-                umvaddstr(pager, lineno - offset, 0, tmp->str);
+                umvaddnstr(pager, lineno - offset, 0, tmp->str, cols);
             }
 
             lineno++;
@@ -367,13 +367,14 @@ void view_stats(void) { /* {{{ */
 
 void view_task(struct task* this) { /* {{{ */
     /* run `task info` and print it to a window */
-    char* cmdstr;
-    char* title;
+    char*   cmdstr;
+    char*   title = NULL;
+    size_t  size = 0;
 
     /* build command and title */
     asprintf(&cmdstr, "task %s info rc._forcecolor=no rc.defaultwidth=%d 2>&1",
              this->uuid, cols - 4);
-    title = (char*)eval_format(cfg.formats.view_compiled, this);
+    eval_format(cfg.formats.view_compiled, this, &title, &size);
 
     /* run pager */
     pager_command(cmdstr, title, 0, 1, 4);
@@ -0,0 +1,237 @@
+/*
+ * schedule.c - find tasks whose colors change as time passes
+ * for tasknc
+ * by mjheagle
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "log.h"
+#include "schedule.h"
+
+/* the number of seconds in a day, the unit of due_soon */
+#define SCHEDULE_DAY                    86400
+
+/**
+ * schedule entry struct - a time at which something may look different
+ * when - the time
+ * tsk  - the task which changes, or NULL for the start of a new day
+ */
+struct schedule_entry {
+    time_t when;
+    struct task* tsk;
+};
+
+/* local functions */
+static bool append_entry(const time_t when, struct task* tsk);
+static void build_schedule(const time_t from);
+static time_t next_midnight(const time_t from);
+static bool schedule_push(const time_t when, struct task* tsk);
+static void sift_down(int pos);
+
+/* min-heap of upcoming entries, ordered by time */
+static struct schedule_entry* heap = NULL;
+static int heap_len = 0;
+static int heap_size = 0;
+
+/* whether the tasks changed since the heap was built */
+static bool schedule_expired = true;
+
+/* the due_soon window the heap was built with, -1 before it is first built */
+static int schedule_window = -1;
+
+/* every entry up to this time has been popped */
+static time_t schedule_time = 0;
+
+bool append_entry(const time_t when, struct task* tsk) { /* {{{ */
+    /**
+     * add an entry to the end of the heap without ordering it
+     * when - the time of the entry
+     * tsk  - the task of the entry
+     * return is whether the entry was added
+     */
+    struct schedule_entry*  tmp;
+
+    if (heap_len >= heap_size) {
+        tmp = realloc(heap, 2 * (heap_len + 1) * sizeof(struct schedule_entry));
+
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "could not grow schedule");
+            return false;
+        }
+
+        heap = tmp;
+        heap_size = 2 * (heap_len + 1);
+    }
+
+    heap[heap_len].when = when;
+    heap[heap_len].tsk = tsk;
+    heap_len++;
+
+    return true;
+} /* }}} */
+
+void build_schedule(const time_t from) { /* {{{ */
+    /**
+     * fill the heap with every time after a point at which a task will
+     * become due soon or overdue
+     * from - the time entries must come after
+     */
+    struct task*    cur;
+    int             i;
+
+    heap_len = 0;
+    append_entry(next_midnight(from), NULL);
+
+    for (cur = head; cur != NULL; cur = cur->next) {
+        if (cur->due == 0) {
+            continue;
+        }
+
+        if (schedule_window > 0 && cur->due - (time_t)schedule_window * SCHEDULE_DAY > from) {
+            append_entry(cur->due - (time_t)schedule_window * SCHEDULE_DAY, cur);
+        }
+
+        if (cur->due > from) {
+            append_entry(cur->due, cur);
+        }
+    }
+
+    /* heapify bottom up, which is linear in the number of entries */
+    for (i = heap_len / 2 - 1; i >= 0; i--) {
+        sift_down(i);
+    }
+
+    schedule_expired = false;
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "built schedule of %d entries", heap_len);
+} /* }}} */
+
+void expire_schedule(void) { /* {{{ */
+    /* rebuild the schedule before it is next used, as tasks have changed */
+    schedule_expired = true;
+} /* }}} */
+
+void free_schedule(void) { /* {{{ */
+    /* release the heap */
+    free(heap);
+    heap = NULL;
+    heap_len = 0;
+    heap_size = 0;
+    schedule_expired = true;
+} /* }}} */
+
+time_t next_midnight(const time_t from) { /* {{{ */
+    /* find the start of the day after a time */
+    struct tm   tm;
+
+    localtime_r(&from, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    tm.tm_hour = 0;
+    tm.tm_mday++;
+    tm.tm_isdst = -1;
+
+    return mktime(&tm);
+} /* }}} */
+
+bool schedule_pop(const time_t now, struct task** tsk) { /* {{{ */
+    /**
+     * take the next entry which is due
+     * now - the current time
+     * tsk - where the task which changed will be stored, NULL meaning that
+     *       every task may have changed
+     * return is whether an entry was due, call until it returns false
+     */
+    struct schedule_entry   top;
+
+    if (schedule_time == 0) {
+        schedule_time = now;
+    }
+
+    /* a new window moves every due soon time */
+    if (schedule_window != cfg.due_soon) {
+        schedule_expired = true;
+
+        if (schedule_window != -1) {
+            schedule_window = cfg.due_soon;
+            *tsk = NULL;
+            return true;
+        }
+
+        schedule_window = cfg.due_soon;
+    }
+
+    /* entries may point to released tasks, so they are only read after
+     * a rebuild from the current list */
+    if (schedule_expired) {
+        build_schedule(schedule_time);
+    }
+
+    if (heap_len == 0 || heap[0].when > now) {
+        schedule_time = now;
+        return false;
+    }
+
+    top = heap[0];
+    heap[0] = heap[--heap_len];
+    sift_down(0);
+
+    /* keep one day boundary queued */
+    if (top.tsk == NULL) {
+        schedule_push(next_midnight(top.when), NULL);
+    }
+
+    *tsk = top.tsk;
+
+    return true;
+} /* }}} */
+
+bool schedule_push(const time_t when, struct task* tsk) { /* {{{ */
+    /**
+     * add an entry to the heap
+     * when - the time of the entry
+     * tsk  - the task of the entry
+     * return is whether the entry was added
+     */
+    int pos;
+
+    if (!append_entry(when, tsk)) {
+        return false;
+    }
+
+    /* sift the entry up to its place */
+    for (pos = heap_len - 1; pos > 0 && heap[(pos - 1) / 2].when > when; pos = (pos - 1) / 2) {
+        heap[pos] = heap[(pos - 1) / 2];
+    }
+
+    heap[pos].when = when;
+    heap[pos].tsk = tsk;
+
+    return true;
+} /* }}} */
+
+void sift_down(int pos) { /* {{{ */
+    /* move an entry down the heap until neither child is earlier */
+    struct schedule_entry   this = heap[pos];
+    int                     child;
+
+    while ((child = 2 * pos + 1) < heap_len) {
+        if (child + 1 < heap_len && heap[child + 1].when < heap[child].when) {
+            child++;
+        }
+
+        if (heap[child].when >= this.when) {
+            break;
+        }
+
+        heap[pos] = heap[child];
+        pos = child;
+    }
+
+    heap[pos] = this;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
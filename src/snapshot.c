@@ -0,0 +1,382 @@
+/*
+ * snapshot.c - cache loaded tasks between runs
+ * for tasknc
+ * by mjheagle
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "snapshot.h"
+#include "tasks.h"
+
+/* identifies a snapshot file and its layout */
+#define SNAPSHOT_MAGIC                  "tncsnap"
+#define SNAPSHOT_VERSION                1
+
+/* pool offset of a string which is not set */
+#define SNAPSHOT_NULL                   UINT32_MAX
+
+/**
+ * snapshot header struct - the start of a snapshot file
+ * magic     - SNAPSHOT_MAGIC
+ * version   - SNAPSHOT_VERSION
+ * count     - the number of task records following the header
+ * filter    - the pool offset of the filter the tasks were loaded with
+ * modified  - the latest modification time of the tasks
+ * stamp     - the data file stamp from before the tasks were loaded
+ * poolsize  - the size of the string pool following the records
+ */
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t filter;
+    uint32_t pad;
+    int64_t modified;
+    uint64_t stamp;
+    uint64_t poolsize;
+};
+
+/**
+ * snapshot record struct - a task with its strings stored as pool offsets
+ */
+struct snapshot_record {
+    int64_t start;
+    int64_t end;
+    int64_t entry;
+    int64_t due;
+    int64_t modified;
+    uint32_t uuid;
+    uint32_t tags;
+    uint32_t project;
+    uint32_t description;
+    uint16_t index;
+    char priority;
+    char pad[5];
+};
+
+/**
+ * snapshot pool struct - the string pool of a snapshot being written
+ * buf  - the strings, each null terminated
+ * len  - the number of bytes used
+ * size - the allocated size of buf
+ */
+struct snapshot_pool {
+    char* buf;
+    size_t len;
+    size_t size;
+};
+
+/* local functions */
+static uint32_t pool_add(struct snapshot_pool* pool, const char* str);
+static const char* pool_get(const char* pool, const uint64_t poolsize, const uint32_t offset);
+static char* snapshot_path(const char* filter, const bool create);
+
+uint32_t pool_add(struct snapshot_pool* pool, const char* str) { /* {{{ */
+    /* append a string to the pool, returning its offset */
+    size_t  len;
+    size_t  offset = pool->len;
+    char*   tmp;
+
+    if (str == NULL) {
+        return SNAPSHOT_NULL;
+    }
+
+    len = strlen(str) + 1;
+
+    if (pool->len + len > pool->size) {
+        tmp = realloc(pool->buf, 2 * (pool->len + len));
+
+        if (tmp == NULL) {
+            return SNAPSHOT_NULL;
+        }
+
+        pool->buf = tmp;
+        pool->size = 2 * (pool->len + len);
+    }
+
+    memcpy(pool->buf + pool->len, str, len);
+    pool->len += len;
+
+    return offset < SNAPSHOT_NULL ? (uint32_t)offset : SNAPSHOT_NULL;
+} /* }}} */
+
+const char* pool_get(const char* pool, const uint64_t poolsize,
+                     const uint32_t offset) { /* {{{ */
+    /* look up a pool string, returning NULL for unset or invalid offsets */
+    if (offset == SNAPSHOT_NULL || offset >= poolsize) {
+        return NULL;
+    }
+
+    return pool + offset;
+} /* }}} */
+
+bool snapshot_read(const char* filter, struct arena* arena,
+                   struct task** tasks, time_t* modified,
+                   uint64_t* stamp) { /* {{{ */
+    /**
+     * read the snapshot saved for a filter
+     * filter   - the filter the tasks were loaded with
+     * arena    - the arena the tasks are allocated from
+     * tasks    - where the first task of the list read will be stored
+     * modified - where the latest modification time of the tasks will be stored
+     * stamp    - where the data file stamp of the snapshot will be stored
+     * return is whether a valid snapshot was read
+     */
+    const struct snapshot_header*   hdr;
+    const struct snapshot_record*   rec;
+    struct stat                     st;
+    struct task*                    this;
+    struct task*                    last = NULL;
+    const char*                     map;
+    const char*                     saved;
+    char*                           pool;
+    char*                           path;
+    uint32_t                        i;
+    int                             fd;
+
+    *tasks = NULL;
+    path = snapshot_path(filter, false);
+
+    if (path == NULL) {
+        return false;
+    }
+
+    fd = open(path, O_RDONLY);
+    free(path);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+        close(fd);
+        return false;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    /* validate the layout before trusting any offsets */
+    hdr = (const struct snapshot_header*)map;
+    rec = (const struct snapshot_record*)(hdr + 1);
+
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        hdr->version != SNAPSHOT_VERSION ||
+        (uint64_t)st.st_size != sizeof(struct snapshot_header) +
+        (uint64_t)hdr->count * sizeof(struct snapshot_record) + hdr->poolsize ||
+        hdr->poolsize == 0 || map[st.st_size - 1] != 0) {
+        tnc_fprintf(logfp, LOG_WARN, "ignoring invalid snapshot");
+        munmap((void*)map, st.st_size);
+        return false;
+    }
+
+    /* the file name is a hash of the filter, so check for collisions */
+    saved = pool_get((const char*)(rec + hdr->count), hdr->poolsize, hdr->filter);
+
+    if (saved == NULL || !str_eq(saved, filter != NULL ? filter : "")) {
+        munmap((void*)map, st.st_size);
+        return false;
+    }
+
+    /* copy every string at once, tasks point into the copy */
+    pool = arena_alloc(arena, hdr->poolsize);
+
+    if (pool == NULL) {
+        munmap((void*)map, st.st_size);
+        return false;
+    }
+
+    memcpy(pool, rec + hdr->count, hdr->poolsize);
+
+    for (i = 0; i < hdr->count; i++, rec++) {
+        this = malloc_task(arena);
+
+        if (this == NULL) {
+            break;
+        }
+
+        this->index = rec->index;
+        this->uuid = (char*)pool_get(pool, hdr->poolsize, rec->uuid);
+        this->tags = (char*)pool_get(pool, hdr->poolsize, rec->tags);
+        this->start = rec->start;
+        this->end = rec->end;
+        this->entry = rec->entry;
+        this->due = rec->due;
+        this->modified = rec->modified;
+        this->project = (char*)pool_get(pool, hdr->poolsize, rec->project);
+        this->priority = rec->priority;
+        this->description = (char*)pool_get(pool, hdr->poolsize, rec->description);
+
+        if (this->uuid == NULL || this->description == NULL) {
+            continue;
+        }
+
+        intern_task(this, arena);
+
+        /* set pointers */
+        this->prev = last;
+
+        if (last == NULL) {
+            *tasks = this;
+        } else {
+            last->next = this;
+        }
+
+        last = this;
+    }
+
+    *modified = hdr->modified;
+    *stamp = hdr->stamp;
+    tnc_fprintf(logfp, LOG_DEBUG, "read %u tasks from snapshot", hdr->count);
+    munmap((void*)map, st.st_size);
+
+    return true;
+} /* }}} */
+
+char* snapshot_path(const char* filter, const bool create) { /* {{{ */
+    /**
+     * find the snapshot file for a filter
+     * filter - the filter the snapshot holds tasks for
+     * create - whether to create the cache directory
+     * return is the path, which must be freed, or NULL
+     */
+    char*           dir;
+    char*           path;
+    char*           xdg_cache_home = getenv("XDG_CACHE_HOME");
+    char*           home = getenv("HOME");
+    const char*     pos;
+    uint64_t        hash = 14695981039346656037ULL;
+
+    if (xdg_cache_home != NULL && *xdg_cache_home != 0) {
+        asprintf(&dir, "%s/tasknc", xdg_cache_home);
+    } else if (home != NULL) {
+        asprintf(&dir, "%s/.cache/tasknc", home);
+    } else {
+        return NULL;
+    }
+
+    /* create the cache directory and its parent */
+    if (create && mkdir(dir, 0700) != 0 && errno == ENOENT) {
+        *strrchr(dir, '/') = 0;
+        mkdir(dir, 0700);
+        dir[strlen(dir)] = '/';
+        mkdir(dir, 0700);
+    }
+
+    /* name the file by the fnv-1a hash of the filter */
+    for (pos = filter != NULL ? filter : ""; *pos != 0; pos++) {
+        hash = (hash ^ (unsigned char)*pos) * 1099511628211ULL;
+    }
+
+    asprintf(&path, "%s/snapshot-%016llx", dir, (unsigned long long)hash);
+    free(dir);
+
+    return path;
+} /* }}} */
+
+bool snapshot_write(const char* filter, const struct task* tasks,
+                    const time_t modified, const uint64_t stamp) { /* {{{ */
+    /**
+     * save tasks to the snapshot for a filter
+     * filter   - the filter the tasks were loaded with
+     * tasks    - the first task of the list to save
+     * modified - the latest modification time of the tasks
+     * stamp    - the data file stamp from before the tasks were loaded
+     * return is whether the snapshot was written
+     */
+    struct snapshot_header  hdr;
+    struct snapshot_record* records;
+    struct snapshot_record* rec;
+    struct snapshot_pool    pool = {NULL, 0, 0};
+    const struct task*      cur;
+    FILE*                   out;
+    char*                   path;
+    char*                   tmppath;
+    uint32_t                count = 0;
+    bool                    ok;
+
+    for (cur = tasks; cur != NULL; cur = cur->next) {
+        count++;
+    }
+
+    records = calloc(count > 0 ? count : 1, sizeof(struct snapshot_record));
+
+    if (records == NULL) {
+        return false;
+    }
+
+    /* build records, the filter is the first pool string */
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.count = count;
+    hdr.filter = pool_add(&pool, filter != NULL ? filter : "");
+    hdr.modified = modified;
+    hdr.stamp = stamp;
+
+    for (cur = tasks, rec = records; cur != NULL; cur = cur->next, rec++) {
+        rec->start = cur->start;
+        rec->end = cur->end;
+        rec->entry = cur->entry;
+        rec->due = cur->due;
+        rec->modified = cur->modified;
+        rec->uuid = pool_add(&pool, cur->uuid);
+        rec->tags = pool_add(&pool, cur->tags);
+        rec->project = pool_add(&pool, cur->project);
+        rec->description = pool_add(&pool, cur->description);
+        rec->index = cur->index;
+        rec->priority = cur->priority;
+    }
+
+    hdr.poolsize = pool.len;
+
+    /* write to a temporary file and move it into place */
+    path = snapshot_path(filter, true);
+    ok = path != NULL && pool.buf != NULL;
+
+    if (ok) {
+        asprintf(&tmppath, "%s.%d", path, (int)getpid());
+        out = fopen(tmppath, "w");
+        ok = out != NULL &&
+             fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+             fwrite(records, sizeof(struct snapshot_record), count, out) == count &&
+             fwrite(pool.buf, 1, pool.len, out) == pool.len;
+
+        if (out != NULL && fclose(out) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmppath, path) != 0) {
+            ok = false;
+        }
+
+        if (!ok) {
+            tnc_fprintf(logfp, LOG_WARN, "could not write snapshot %s", path);
+            unlink(tmppath);
+        } else {
+            tnc_fprintf(logfp, LOG_DEBUG, "wrote %u tasks to snapshot %s", count, path);
+        }
+
+        free(tmppath);
+    }
+
+    free(path);
+    free(records);
+    free(pool.buf);
+
+    return ok;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
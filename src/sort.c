@@ -4,118 +4,569 @@
  * by mjheagle
  */
 
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "common.h"
+#include "log.h"
 #include "sort.h"
+#include "symbols.h"
 
-/* local functions */
-static bool compare_tasks(const struct task* a,
-                          const struct task* b,
-                          const char* mode_queue);
+/* the most keys a sort mode can be compiled into */
+#define SORT_MAX_KEYS                   16
+
+/* the fewest tasks sorted by packed keys, fewer are simply compared */
+#define PACKED_SORT_MIN                 64
+
+/* the number of recently used sort modes whose order is kept */
+#define SORT_ORDER_CACHE                4
+
+/* the most threads used when sort_threads is 0 */
+#define SORT_THREADS_AUTO_MAX           8
+
+/**
+ * sort key struct - one step of a compiled sort mode
+ * field  - the sort mode character naming the field compared
+ * invert - whether the order of the field is reversed
+ */
+struct sort_key {
+    char field;
+    bool invert;
+};
+
+/**
+ * sort item struct - a task with its packed sort key
+ * key  - the leading fields of the sort plan packed into an integer,
+ *        so that comparing keys compares those fields in order
+ * task - the task
+ */
+struct sort_item {
+    uint64_t key;
+    struct task* task;
+};
+
+/**
+ * sort order struct - the tasks as they were last sorted by a sort mode
+ * mode       - the sort mode
+ * tasks      - the tasks in sorted order
+ * n          - the number of tasks
+ * generation - the task generation which was sorted
+ * used       - when the order was last used, the oldest is replaced first
+ */
+struct sort_order {
+    char* mode;
+    struct task** tasks;
+    int n;
+    unsigned long generation;
+    unsigned long used;
+};
+
+/**
+ * sort chunk struct - a part of the task array handled by one thread
+ * tasks - the start of the part
+ * tmp   - scratch space for the part
+ * n     - the number of tasks in the part
+ * mid   - when merging, the number of tasks in the sorted first half
+ */
+struct sort_chunk {
+    struct task** tasks;
+    struct task** tmp;
+    int n;
+    int mid;
+};
 
+/* local functions */
+static int bit_width(uint64_t value);
+static void compile_sort_plan(const char* mode);
+static int compare_tasks(const struct task* a, const struct task* b, const int first);
+static struct sort_order* find_sort_order(const struct task* first, const int n);
+static struct task* link_tasks(struct task** tasks, const int n);
+static void* merge_chunk(void* arg);
+static void merge_runs(struct task** src, struct task** dst, const int lo, const int mid,
+                       const int hi, const int first);
+static void merge_sort(struct task** tasks, struct task** tmp, const int n, const int first);
+static int pack_keys(struct sort_item* items, const int n, int* bits);
+static void parallel_sort(struct task** tasks, struct task** tmp, const int n,
+                          const int threads);
 static int priority_to_int(const char pri);
-static void sort_tasks(struct task* first, struct task* last);
-static void swap_tasks(struct task* a, struct task* b);
+static void radix_sort(struct sort_item* items, struct sort_item* tmp, const int n,
+                       const int bits);
+static void run_workers(void* (*func)(void*), struct sort_chunk* chunks, const int count);
+static void save_sort_order(struct task** tasks, const int n);
+static void* sort_chunk(void* arg);
+static bool sort_packed(struct task** tasks, struct task** tmp, const int n);
+static int sort_threads(const int n);
+
+/* the sort plan compiled from the last sort mode seen */
+static struct sort_key plan[SORT_MAX_KEYS];
+static int plan_length = 0;
+static char* plan_mode = NULL;
+
+/* orders of recently used sort modes, which are only valid while the
+ * generation is unchanged since tasks were created or removed */
+static struct sort_order orders[SORT_ORDER_CACHE];
+static unsigned long sort_generation = 1;
+static unsigned long sort_clock = 0;
+
+int bit_width(uint64_t value) { /* {{{ */
+    /* count the bits needed to store a value */
+    int ret = 0;
+
+    for (; value != 0; value >>= 1) {
+        ret++;
+    }
+
+    return ret;
+} /* }}} */
 
-bool compare_tasks(const struct task* a,
-                   const struct task* b,
-                   const char* mode_queue) { /* {{{ */
+void compile_sort_plan(const char* mode) { /* {{{ */
     /**
-     * compare two tasks to determine order
-     * a return of 1 means that the tasks should be swapped (b comes before a)
-     * a          - the first task to be compared
-     * b          - the second task to be compared
-     * mode_queue - the remaining tests to be evaluated
+     * compile a sort mode string into the sort plan, unless it already is
+     * mode - the sort mode, each character naming a field to compare
+     *        in order, where capital letters reverse the order
+     * compilation stops at the first character not naming a field
      */
-    bool    ret = false;
-    int     tmp;
-    int     pri0;
-    int     pri1;
-    char    sort_mode = *mode_queue;
-    bool    invert = false;
-
-    /* check for inverted order */
-    if (sort_mode >= 'A' && sort_mode <= 'Z') {
-        sort_mode += 32;
-        invert = true;
-    }
-
-    /* determine sort algorithm and apply it */
-    switch (sort_mode) {
-    case 'n':       // sort by index
-        if (XOR(invert, a->index < b->index)) {
-            ret = true;
+    char field;
+
+    if (mode == NULL) {
+        mode = "";
+    }
+
+    if (plan_mode != NULL && str_eq(plan_mode, mode)) {
+        return;
+    }
+
+    free(plan_mode);
+    plan_mode = strdup(mode);
+    plan_length = 0;
+
+    for (; *mode != 0 && plan_length < SORT_MAX_KEYS; mode++) {
+        field = *mode;
+        plan[plan_length].invert = false;
+
+        if (field >= 'A' && field <= 'Z') {
+            field += 32;
+            plan[plan_length].invert = true;
         }
 
-        break;
+        if (strchr("dnpru", field) == NULL) {
+            break;
+        }
+
+        plan[plan_length++].field = field;
+    }
+
+    tnc_fprintf(logfp, LOG_DEBUG, "sort plan: %d keys from '%s'", plan_length, plan_mode);
+} /* }}} */
+
+int compare_tasks(const struct task* a, const struct task* b,
+                  const int first) { /* {{{ */
+    /**
+     * compare two tasks using the compiled sort plan
+     * a     - the first task to be compared
+     * b     - the second task to be compared
+     * first - the first key of the plan to compare
+     * return is negative if a comes before b, positive if b comes before a,
+     * and 0 if the plan does not order them
+     */
+    int i;
+    int ret;
 
-    case 'p':       // sort by project name
-        if (a->project == NULL) {
-            if (b->project != NULL) {
-                ret = true;
+    for (i = first; i < plan_length; i++) {
+        ret = 0;
+
+        switch (plan[i].field) {
+        case 'n':       // sort by index
+            ret = (int)a->index - (int)b->index;
+            break;
+
+        case 'p':       // sort by project name, tasks without a project first
+            if (a->project_id == 0 || b->project_id == 0) {
+                if (a->project_id != b->project_id) {
+                    return a->project_id == 0 ? -1 : 1;
+                }
+
+                continue;
             }
 
+            ret = symbol_rank(a->project_id) - symbol_rank(b->project_id);
             break;
-        }
 
-        if (b->project == NULL) {
+        case 'd':       // sort by due date, tasks without a due date last
+            if (a->due == 0 || b->due == 0) {
+                if (a->due != b->due) {
+                    return a->due == 0 ? 1 : -1;
+                }
+
+                continue;
+            }
+
+            ret = (a->due > b->due) - (a->due < b->due);
+            break;
+
+        case 'r':       // sort by priority, highest first
+            ret = priority_to_int(b->priority) - priority_to_int(a->priority);
+            break;
+
+        case 'u':       // sort by uuid
+            ret = strcmp(a->uuid, b->uuid);
+            break;
+
+        default:
             break;
         }
 
-        tmp = strcmp(a->project, b->project);
+        if (ret != 0) {
+            return plan[i].invert ? -ret : ret;
+        }
+    }
 
-        if (XOR(invert, tmp < 0)) {
-            ret = true;
+    return 0;
+} /* }}} */
+
+void expire_sort_orders(void) { /* {{{ */
+    /* forget the orders of every sort mode, as tasks have changed */
+    sort_generation++;
+} /* }}} */
+
+struct sort_order* find_sort_order(const struct task* first, const int n) { /* {{{ */
+    /**
+     * find the order the tasks were last sorted in by the compiled mode
+     * first - the first task in the list being sorted
+     * n     - the number of tasks in the list
+     * return is the order, or NULL if there is none for these tasks
+     */
+    int i;
+    int j;
+
+    for (i = 0; i < SORT_ORDER_CACHE; i++) {
+        if (orders[i].generation != sort_generation || orders[i].n != n ||
+            !str_eq(orders[i].mode, plan_mode)) {
+            continue;
         }
 
-        if (tmp == 0) {
-            ret = compare_tasks(a, b, mode_queue + 1);
+        /* make sure the order is of this list */
+        for (j = 0; j < n && orders[i].tasks[j] != first; j++);
+
+        if (j < n) {
+            orders[i].used = ++sort_clock;
+            return &orders[i];
         }
+    }
 
-        break;
+    return NULL;
+} /* }}} */
+
+void free_sort_plan(void) { /* {{{ */
+    /* release the compiled sort plan and the orders of recent modes */
+    int i;
 
-    case 'd':       // sort by due date
-        if (a->due == 0) {
-            if (b->due == 0) {
-                ret = compare_tasks(a, b, mode_queue + 1);
+    for (i = 0; i < SORT_ORDER_CACHE; i++) {
+        free(orders[i].mode);
+        free(orders[i].tasks);
+    }
+
+    memset(orders, 0, sizeof(orders));
+    free(plan_mode);
+    plan_mode = NULL;
+    plan_length = 0;
+} /* }}} */
+
+struct task* link_tasks(struct task** tasks, const int n) { /* {{{ */
+    /**
+     * relink a list in the order of an array
+     * tasks - the tasks in their new order
+     * n     - the number of tasks, at least one
+     * return is the new first task in the list
+     */
+    int i;
+
+    for (i = 0; i < n; i++) {
+        tasks[i]->prev = i > 0 ? tasks[i - 1] : NULL;
+        tasks[i]->next = i < n - 1 ? tasks[i + 1] : NULL;
+    }
+
+    return tasks[0];
+} /* }}} */
+
+void* merge_chunk(void* arg) { /* {{{ */
+    /* worker merging the two sorted halves of a chunk */
+    struct sort_chunk* chunk = arg;
+
+    if (chunk->mid < chunk->n) {
+        merge_runs(chunk->tasks, chunk->tmp, 0, chunk->mid, chunk->n, 0);
+        memcpy(chunk->tasks, chunk->tmp, chunk->n * sizeof(struct task*));
+    }
+
+    return NULL;
+} /* }}} */
+
+void merge_runs(struct task** src, struct task** dst, const int lo,
+                const int mid, const int hi, const int first) { /* {{{ */
+    /**
+     * stable merge of two neighbouring sorted runs
+     * src   - the array holding the runs
+     * dst   - the array the merged run is stored in, at the same position
+     * lo    - the start of the first run
+     * mid   - the start of the second run
+     * hi    - the end of the second run
+     * first - the first key of the plan to compare
+     */
+    int i;
+    int j;
+    int k;
+
+    for (i = lo, j = mid, k = lo; k < hi; k++) {
+        if (j >= hi || (i < mid && compare_tasks(src[j], src[i], first) >= 0)) {
+            dst[k] = src[i++];
+        } else {
+            dst[k] = src[j++];
+        }
+    }
+} /* }}} */
+
+void merge_sort(struct task** tasks, struct task** tmp, const int n,
+                const int first) { /* {{{ */
+    /**
+     * stable sort of an array of tasks
+     * tasks - the array to sort
+     * tmp   - scratch space for at least n tasks
+     * n     - the number of tasks
+     * first - the first key of the plan to compare
+     */
+    struct task**   src = tasks;
+    struct task**   dst = tmp;
+    struct task**   swap;
+    struct task*    cur;
+    int             width;
+    int             lo;
+    int             mid;
+    int             hi;
+    int             i;
+    int             j;
+
+    /* sort short runs in place with insertion sort */
+    for (lo = 0; lo < n; lo += 8) {
+        hi = lo + 8 < n ? lo + 8 : n;
+
+        for (i = lo + 1; i < hi; i++) {
+            cur = tasks[i];
+
+            for (j = i; j > lo && compare_tasks(cur, tasks[j - 1], first) < 0; j--) {
+                tasks[j] = tasks[j - 1];
+            }
+
+            tasks[j] = cur;
+        }
+    }
+
+    /* merge runs bottom up, alternating between the arrays */
+    for (width = 8; width < n; width *= 2) {
+        for (lo = 0; lo < n; lo += 2 * width) {
+            mid = lo + width < n ? lo + width : n;
+            hi = lo + 2 * width < n ? lo + 2 * width : n;
+
+            /* already ordered runs, which reloads produce, are copied */
+            if (mid == hi || compare_tasks(src[mid - 1], src[mid], first) <= 0) {
+                memcpy(dst + lo, src + lo, (hi - lo) * sizeof(struct task*));
+                continue;
+            }
+
+            merge_runs(src, dst, lo, mid, hi, first);
+        }
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != tasks) {
+        memcpy(tasks, src, n * sizeof(struct task*));
+    }
+} /* }}} */
+
+int pack_keys(struct sort_item* items, const int n, int* bits) { /* {{{ */
+    /**
+     * pack the leading integer fields of the sort plan into a key per task
+     * items - the tasks to compute keys for
+     * n     - the number of tasks
+     * bits  - where the number of bits used by the keys will be stored
+     * return is the number of plan keys packed, the rest must be compared
+     */
+    struct task*    tsk;
+    uint64_t        value;
+    uint64_t        key;
+    uint64_t        range[SORT_MAX_KEYS];
+    time_t          mindue[SORT_MAX_KEYS];
+    time_t          maxdue;
+    int             width[SORT_MAX_KEYS];
+    int             nranks = symbol_count();
+    int             packed;
+    int             i;
+    int             j;
+
+    /* find the width of each field, stopping at strings or a full key */
+    *bits = 0;
+
+    for (packed = 0; packed < plan_length; packed++) {
+        switch (plan[packed].field) {
+        case 'n':
+            width[packed] = 16;
+            break;
+
+        case 'r':
+            width[packed] = 2;
+            break;
+
+        case 'p':
+            width[packed] = bit_width(nranks);
+            break;
+
+        case 'd':
+            /* dues are stored relative to the earliest one, the value
+             * after the latest is left for tasks without a due date */
+            mindue[packed] = 0;
+            maxdue = 0;
+
+            for (j = 0; j < n; j++) {
+                if (items[j].task->due == 0) {
+                    continue;
+                }
+
+                if (mindue[packed] == 0 || items[j].task->due < mindue[packed]) {
+                    mindue[packed] = items[j].task->due;
+                }
+
+                if (maxdue == 0 || items[j].task->due > maxdue) {
+                    maxdue = items[j].task->due;
+                }
             }
 
+            range[packed] = (uint64_t)(maxdue - mindue[packed]);
+            width[packed] = range[packed] < UINT64_MAX ? bit_width(range[packed] + 1) : 65;
             break;
-        } else if (b->due == 0) {
-            ret = true;
+
+        default:
+            width[packed] = 65;
             break;
-        } else if (XOR(invert, a->due < b->due)) {
-            ret = true;
         }
 
-        break;
+        if (*bits + width[packed] > 64) {
+            break;
+        }
 
-    case 'r':       // sort by priority
-        pri0 = priority_to_int(a->priority);
-        pri1 = priority_to_int(b->priority);
+        *bits += width[packed];
+    }
 
-        if (pri0 == pri1) {
-            ret = compare_tasks(a, b, mode_queue + 1);
-        } else {
-            ret = XOR(invert, pri0 > pri1);
+    /* build the keys, the first field in the most significant bits */
+    for (j = 0; j < n; j++) {
+        tsk = items[j].task;
+        key = 0;
+
+        for (i = 0; i < packed; i++) {
+            switch (plan[i].field) {
+            case 'n':
+                value = plan[i].invert ? 0xffff - tsk->index : tsk->index;
+                break;
+
+            case 'r':
+                value = priority_to_int(tsk->priority);
+                value = plan[i].invert ? value : 3 - value;
+                break;
+
+            case 'p':
+                /* tasks without a project come first in either order */
+                value = symbol_rank(tsk->project_id);
+                value = plan[i].invert && value != 0 ? (uint64_t)nranks + 1 - value : value;
+                break;
+
+            case 'd':
+                /* tasks without a due date come last in either order */
+                if (tsk->due == 0) {
+                    value = range[i] + 1;
+                } else {
+                    value = (uint64_t)(tsk->due - mindue[i]);
+                    value = plan[i].invert ? range[i] - value : value;
+                }
+
+                break;
+
+            default:
+                value = 0;
+                break;
+            }
+
+            key = width[i] < 64 ? (key << width[i]) | value : value;
         }
 
-        break;
+        items[j].key = key;
+    }
 
-    case 'u':       // sort by uuid
-        if (XOR(invert, strcmp(a->uuid, b->uuid) < 0)) {
-            ret = true;
+    return packed;
+} /* }}} */
+
+void parallel_sort(struct task** tasks, struct task** tmp, const int n,
+                   const int threads) { /* {{{ */
+    /**
+     * stable sort of an array of tasks on several threads
+     * each thread sorts a chunk of the array, then neighbouring chunks are
+     * merged in pairs until one is left, which gives the serial result
+     * tasks   - the array to sort
+     * tmp     - scratch space for at least n tasks
+     * n       - the number of tasks
+     * threads - the number of chunks to sort at once
+     */
+    struct sort_chunk*  chunks;
+    int                 count;
+    int                 lo;
+    int                 hi;
+    int                 i;
+
+    chunks = calloc(threads, sizeof(struct sort_chunk));
+
+    if (chunks == NULL) {
+        if (!sort_packed(tasks, tmp, n)) {
+            merge_sort(tasks, tmp, n, 0);
         }
 
-        break;
+        return;
+    }
 
-    case 0:
-    default:
-        return false;
-        break;
+    /* ranks are computed on first use, which must not happen in a thread */
+    symbol_rank(symbol_count());
+
+    for (i = 0; i < threads; i++) {
+        lo = (long long)n * i / threads;
+        hi = (long long)n * (i + 1) / threads;
+        chunks[i].tasks = tasks + lo;
+        chunks[i].tmp = tmp + lo;
+        chunks[i].n = hi - lo;
     }
 
-    return ret;
+    run_workers(sort_chunk, chunks, threads);
+
+    for (count = threads; count > 1; count = (count + 1) / 2) {
+        for (i = 0; i < count / 2; i++) {
+            chunks[i].tasks = chunks[2 * i].tasks;
+            chunks[i].tmp = chunks[2 * i].tmp;
+            chunks[i].mid = chunks[2 * i].n;
+            chunks[i].n = chunks[2 * i].n + chunks[2 * i + 1].n;
+        }
+
+        /* an odd chunk out waits for the next round */
+        if (count % 2 == 1) {
+            chunks[count / 2] = chunks[count - 1];
+            chunks[count / 2].mid = chunks[count / 2].n;
+        }
+
+        run_workers(merge_chunk, chunks, (count + 1) / 2);
+    }
+
+    free(chunks);
 } /* }}} */
 
 int priority_to_int(const char pri) { /* {{{ */
@@ -140,125 +591,373 @@ int priority_to_int(const char pri) { /* {{{ */
     }
 } /* }}} */
 
-void sort_wrapper(struct task* first) { /* {{{ */
+void radix_sort(struct sort_item* items, struct sort_item* tmp,
+                const int n, const int bits) { /* {{{ */
     /**
-     * a wrapper around sort_tasks that finds the last element
-     * in the linked list to pass to the aforementioned function
+     * stable lsd radix sort of tasks by their packed keys
+     * items - the array to sort
+     * tmp   - scratch space for at least n items
+     * n     - the number of items
+     * bits  - the number of low bits of the keys which are used
      */
-    struct task* last;
+    struct sort_item*   src = items;
+    struct sort_item*   dst = tmp;
+    struct sort_item*   swap;
+    size_t              count[256];
+    size_t              offset;
+    size_t              c;
+    int                 shift;
+    int                 i;
+
+    for (shift = 0; shift < bits; shift += 8) {
+        memset(count, 0, sizeof(count));
+
+        for (i = 0; i < n; i++) {
+            count[(src[i].key >> shift) & 0xff]++;
+        }
 
-    /* loop through looking for last item */
-    last = first;
+        /* skip digits which are the same for every task */
+        if (count[(src[0].key >> shift) & 0xff] == (size_t)n) {
+            continue;
+        }
+
+        for (i = 0, offset = 0; i < 256; i++) {
+            c = count[i];
+            count[i] = offset;
+            offset += c;
+        }
 
-    while (last->next != NULL) {
-        last = last->next;
+        for (i = 0; i < n; i++) {
+            dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+        }
+
+        swap = src;
+        src = dst;
+        dst = swap;
     }
 
-    /* run sort with last value */
-    sort_tasks(first, last);
+    if (src != items) {
+        memcpy(items, src, n * sizeof(struct sort_item));
+    }
 } /* }}} */
 
-void sort_tasks(struct task* first,
-                struct task* last) { /* {{{ */
-    /* sort a list of tasks from first to last */
-    struct task* start;
-    struct task* cur;
-    struct task* oldcur;
-
-    /* check if we are done */
-    if (first == last) {
-        return;
+void run_workers(void* (*func)(void*), struct sort_chunk* chunks,
+                 const int count) { /* {{{ */
+    /**
+     * run a function on each chunk, each in its own thread
+     * func   - the function to run
+     * chunks - the chunks to pass to the function
+     * count  - the number of chunks
+     */
+    pthread_t*  workers;
+    bool*       started;
+    int         i;
+
+    workers = calloc(count, sizeof(pthread_t));
+    started = calloc(count, sizeof(bool));
+
+    /* the first chunk is handled by this thread, as is any chunk
+     * which a thread could not be started for */
+    for (i = 1; i < count; i++) {
+        started[i] = workers != NULL && started != NULL &&
+                     pthread_create(&workers[i], NULL, func, &chunks[i]) == 0;
     }
 
-    /* set start and current */
-    start = first;
-    cur = start->next;
+    func(&chunks[0]);
 
-    /* iterate through to right end, sorting as we go */
-    while (1) {
-        if (compare_tasks(start, cur, cfg.sortmode)) {
-            swap_tasks(start, cur);
+    for (i = 1; i < count; i++) {
+        if (started != NULL && started[i]) {
+            pthread_join(workers[i], NULL);
+        } else {
+            func(&chunks[i]);
         }
+    }
+
+    free(workers);
+    free(started);
+} /* }}} */
+
+void save_sort_order(struct task** tasks, const int n) { /* {{{ */
+    /**
+     * keep the result of sorting by the compiled mode, replacing the order
+     * of the same mode, an expired order or the least recently used one
+     * tasks - the sorted tasks, which the order takes ownership of
+     * n     - the number of tasks
+     */
+    struct sort_order*  order = &orders[0];
+    struct task**       tmp;
+    int                 i;
 
-        if (cur == last) {
+    for (i = 0; i < SORT_ORDER_CACHE; i++) {
+        if (orders[i].mode != NULL && str_eq(orders[i].mode, plan_mode)) {
+            order = &orders[i];
             break;
         }
 
-        cur = cur->next;
+        /* expired orders count as never used */
+        if ((orders[i].generation == sort_generation ? orders[i].used : 0) <
+            (order->generation == sort_generation ? order->used : 0)) {
+            order = &orders[i];
+        }
+    }
+
+    if (order->mode == NULL || !str_eq(order->mode, plan_mode)) {
+        free(order->mode);
+        order->mode = strdup(plan_mode);
+    }
+
+    /* the sort buffer also held scratch space, which is not needed */
+    tmp = realloc(tasks, n * sizeof(struct task*));
+    free(order->tasks);
+    order->tasks = tmp != NULL ? tmp : tasks;
+    order->n = n;
+    order->generation = sort_generation;
+    order->used = ++sort_clock;
+} /* }}} */
+
+#ifdef TASKNC_INCLUDE_TESTS
+bool sort_array(struct task** tasks, const int n, const char* mode,
+                const enum sort_method method) { /* {{{ */
+    /**
+     * sort an array of tasks with one of the sorts sort_wrapper picks between,
+     * so that the test suite can check that they agree
+     * tasks  - the array to sort
+     * n      - the number of tasks
+     * mode   - the sort mode
+     * method - the sort to use, a parallel sort runs on three threads
+     * return is false if the tasks could not be sorted that way
+     */
+    struct task**   tmp;
+    bool            ret = true;
+
+    compile_sort_plan(mode);
+    tmp = malloc(n * sizeof(struct task*));
+
+    if (tmp == NULL) {
+        return false;
+    }
+
+    switch (method) {
+    case SORT_MERGE:
+        merge_sort(tasks, tmp, n, 0);
+        break;
+
+    case SORT_PACKED:
+        ret = sort_packed(tasks, tmp, n);
+        break;
+
+    case SORT_PARALLEL:
+        parallel_sort(tasks, tmp, n, 3);
+        break;
+    }
+
+    free(tmp);
+
+    return ret;
+} /* }}} */
+#endif
+
+void* sort_chunk(void* arg) { /* {{{ */
+    /* worker sorting a chunk of the task array */
+    struct sort_chunk* chunk = arg;
+
+    if (!sort_packed(chunk->tasks, chunk->tmp, chunk->n)) {
+        merge_sort(chunk->tasks, chunk->tmp, chunk->n, 0);
+    }
+
+    return NULL;
+} /* }}} */
+
+bool sort_packed(struct task** tasks, struct task** tmp, const int n) { /* {{{ */
+    /**
+     * sort an array of tasks by packed keys, comparing only the fields
+     * which could not be packed among tasks with equal keys
+     * tasks - the array to sort
+     * tmp   - scratch space for at least n tasks
+     * n     - the number of tasks
+     * return is false if the plan does not start with a packable field
+     */
+    struct sort_item*   items;
+    int                 packed;
+    int                 bits;
+    int                 lo;
+    int                 hi;
+    int                 i;
+
+    if (n < PACKED_SORT_MIN || plan_length == 0 || plan[0].field == 'u') {
+        return false;
     }
 
-    /* swap first and cur */
-    swap_tasks(first, cur);
+    items = malloc(2 * n * sizeof(struct sort_item));
 
-    /* save this cur */
-    oldcur = cur;
+    if (items == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < n; i++) {
+        items[i].task = tasks[i];
+    }
 
-    /* sort left side */
-    cur = cur->prev;
+    packed = pack_keys(items, n, &bits);
+    radix_sort(items, items + n, n, bits);
 
-    if (cur != NULL) {
-        if ((first->prev != cur) && (cur->next != first)) {
-            sort_tasks(first, cur);
+    for (i = 0; i < n; i++) {
+        tasks[i] = items[i].task;
+    }
+
+    /* break ties on the remaining fields, such as uuid */
+    if (packed < plan_length) {
+        for (lo = 0; lo < n; lo = hi) {
+            for (hi = lo + 1; hi < n && items[hi].key == items[lo].key; hi++);
+
+            if (hi - lo > 1) {
+                merge_sort(tasks + lo, tmp, hi - lo, packed);
+            }
         }
     }
 
-    /* sort right side */
-    cur = oldcur->next;
+    free(items);
 
-    if (cur != NULL) {
-        if ((cur->prev != last) && (last->next != cur)) {
-            sort_tasks(cur, last);
+    return true;
+} /* }}} */
+
+int sort_position(struct task* const* tasks, const int n, const struct task* tsk,
+                  const int pos) { /* {{{ */
+    /**
+     * find where a changed task belongs in a sorted array of tasks
+     * tasks - the sorted array, holding the old copy of the task at pos
+     * n     - the number of tasks in the array
+     * tsk   - the changed task
+     * pos   - the position of the old copy, which is skipped in the search
+     *         and kept among tasks the sort mode does not order tsk
+     *         against, as a full sort would
+     * return is the position tsk should be moved to
+     */
+    int lo = 0;
+    int hi = n - 1;
+    int first;
+    int mid;
+
+    compile_sort_plan(cfg.sortmode);
+
+    /* find the first other task not sorting before tsk */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+
+        if (compare_tasks(tasks[mid < pos ? mid : mid + 1], tsk, 0) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
+
+    first = lo;
+
+    /* find the first other task sorting after tsk */
+    for (hi = n - 1; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+
+        if (compare_tasks(tasks[mid < pos ? mid : mid + 1], tsk, 0) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return pos < first ? first : (pos > lo ? lo : pos);
+} /* }}} */
+
+int sort_threads(const int n) { /* {{{ */
+    /**
+     * decide how many threads to sort a number of tasks on
+     * n - the number of tasks
+     * return is the number of threads, 1 to sort serially
+     */
+    long threads = cfg.sort_threads;
+
+    if (n < cfg.sort_parallel_min || threads == 1) {
+        return 1;
+    }
+
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = threads > SORT_THREADS_AUTO_MAX ? SORT_THREADS_AUTO_MAX : threads;
+    }
+
+    /* keep every chunk large enough to be worth a thread */
+    threads = threads > n / PACKED_SORT_MIN ? n / PACKED_SORT_MIN : threads;
+
+    return threads > 1 ? threads : 1;
 } /* }}} */
 
-void swap_tasks(struct task* a,
-                struct task* b) { /* {{{ */
-    /* swap the contents of two tasks */
-    unsigned short  ustmp;
-    unsigned int    uitmp;
-    char*           strtmp;
-    char            ctmp;
-
-    ustmp    = a->index;
-    a->index = b->index;
-    b->index = ustmp;
-
-    strtmp  = a->uuid;
-    a->uuid = b->uuid;
-    b->uuid = strtmp;
-
-    strtmp  = a->tags;
-    a->tags = b->tags;
-    b->tags = strtmp;
-
-    uitmp    = a->start;
-    a->start = b->start;
-    b->start = uitmp;
-
-    uitmp  = a->end;
-    a->end = b->end;
-    b->end = uitmp;
-
-    uitmp    = a->entry;
-    a->entry = b->entry;
-    b->entry = uitmp;
-
-    uitmp  = a->due;
-    a->due = b->due;
-    b->due = uitmp;
-
-    strtmp     = a->project;
-    a->project = b->project;
-    b->project = strtmp;
-
-    ctmp        = a->priority;
-    a->priority = b->priority;
-    b->priority = ctmp;
-
-    strtmp         = a->description;
-    a->description = b->description;
-    b->description = strtmp;
+struct task* sort_wrapper(struct task* first) { /* {{{ */
+    /**
+     * sort a list of tasks by the active sort mode
+     * the tasks are sorted as an array of pointers and then relinked,
+     * tasks which the sort mode does not order keep their order
+     * switching back to a recent sort mode restores its order without
+     * sorting, unless tasks were created or removed since
+     * first - the first task in the list
+     * return is the new first task in the list
+     */
+    struct sort_order*  order;
+    struct task**       tasks;
+    struct task*        cur;
+    struct timespec     t0;
+    struct timespec     t1;
+    int                 threads;
+    int                 n = 0;
+    int                 i;
+
+    if (first == NULL) {
+        return NULL;
+    }
+
+    compile_sort_plan(cfg.sortmode);
+
+    /* collect the list into an array */
+    for (cur = first; cur != NULL; cur = cur->next) {
+        n++;
+    }
+
+    order = find_sort_order(first, n);
+
+    if (order != NULL) {
+        tnc_fprintf(logfp, LOG_DEBUG, "restored order of %d tasks for sort mode '%s'",
+                    n, plan_mode);
+        return link_tasks(order->tasks, n);
+    }
+
+    tasks = malloc(2 * n * sizeof(struct task*));
+
+    if (tasks == NULL) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not allocate sort buffer");
+        return first;
+    }
+
+    for (cur = first, i = 0; cur != NULL; cur = cur->next, i++) {
+        tasks[i] = cur;
+    }
+
+    /* sort, on several threads for large lists */
+    threads = sort_threads(n);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (threads > 1) {
+        parallel_sort(tasks, tasks + n, n, threads);
+    } else if (!sort_packed(tasks, tasks + n, n)) {
+        merge_sort(tasks, tasks + n, n, 0);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    tnc_fprintf(logfp, LOG_DEBUG, "sorted %d tasks by '%s' in %.3f ms (%d %s)", n, plan_mode,
+                (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+                threads, threads > 1 ? "threads" : "thread");
+
+    first = link_tasks(tasks, n);
+    save_sort_order(tasks, n);
+
+    return first;
 } /* }}} */
 
 // vim: et ts=4 sw=4 sts=4
@@ -264,7 +264,7 @@ int statusbar_getstr(char** str, const char* msg) { /* {{{ */
     /* get keys and buffer them */
     while (!done) {
         wipe_statusbar();
-        umvaddstr(statusbar, 0, 0, msg);
+        umvaddnstr(statusbar, 0, 0, msg, cols);
         mvwaddnwstr(statusbar, 0, msglen, wstr, str_len);
         wmove(statusbar, 0, msglen + position);
         wrefresh(statusbar);
@@ -417,7 +417,7 @@ void statusbar_message(const int dtmout, const char* format, ...) { /* {{{ */
     wipe_statusbar();
 
     /* print message */
-    umvaddstr(statusbar, 0, 0, message);
+    umvaddnstr(statusbar, 0, 0, message, cols);
     free(message);
 
     /* set timeout */
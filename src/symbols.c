@@ -0,0 +1,231 @@
+/*
+ * symbols.c - intern project and tag names
+ * for tasknc
+ * by mjheagle
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "symbols.h"
+
+/* initial number of hash table slots, a power of two */
+#define SYMBOL_TABLE_MIN                64
+
+/**
+ * symbol struct - an interned string
+ * name - the string, shared by every task using it
+ * len   - the length of name
+ * width - the number of columns name takes on screen
+ * hash  - the hash of name
+ * rank  - the position of name when all symbols are sorted with strcmp
+ */
+struct symbol {
+    char* name;
+    size_t len;
+    int width;
+    uint32_t hash;
+    int rank;
+};
+
+/* local functions */
+static int compare_symbols(const void* a, const void* b);
+static uint32_t hash_string(const char* str, const size_t len);
+static void rank_symbols(void);
+
+/* symbols by id, id 0 is reserved for unset strings */
+static struct symbol* symbols = NULL;
+static int nsymbols = 1;
+static int symbols_size = 0;
+static bool ranks_valid = true;
+
+/* open addressed hash table of symbol ids, 0 marks an empty slot */
+static int* table = NULL;
+static unsigned int table_mask = 0;
+
+int compare_symbols(const void* a, const void* b) { /* {{{ */
+    /* order symbol ids by their names */
+    return strcmp(symbols[*(const int*)a].name, symbols[*(const int*)b].name);
+} /* }}} */
+
+void free_symbols(void) { /* {{{ */
+    /* release every interned string */
+    int i;
+
+    for (i = 1; i < nsymbols; i++) {
+        free(symbols[i].name);
+    }
+
+    free(symbols);
+    free(table);
+    symbols = NULL;
+    table = NULL;
+    nsymbols = 1;
+    symbols_size = 0;
+    table_mask = 0;
+    ranks_valid = true;
+} /* }}} */
+
+uint32_t hash_string(const char* str, const size_t len) { /* {{{ */
+    /* fnv-1a hash of a string */
+    uint32_t    hash = 2166136261u;
+    size_t      i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+    }
+
+    return hash;
+} /* }}} */
+
+int intern(const char* str, const size_t len) { /* {{{ */
+    /**
+     * find or add a symbol
+     * str - the string to intern, which need not be null terminated
+     * len - the length of str
+     * return is the id of the symbol, or 0 if str is NULL or could not be added
+     */
+    struct symbol*  tmp;
+    int*            newtable;
+    uint32_t        hash;
+    unsigned int    slot;
+    unsigned int    newmask;
+    int             id;
+    int             i;
+
+    if (str == NULL) {
+        return 0;
+    }
+
+    hash = hash_string(str, len);
+
+    /* look for an existing symbol */
+    if (table != NULL) {
+        for (slot = hash & table_mask; table[slot] != 0; slot = (slot + 1) & table_mask) {
+            id = table[slot];
+
+            if (symbols[id].hash == hash && symbols[id].len == len &&
+                memcmp(symbols[id].name, str, len) == 0) {
+                return id;
+            }
+        }
+    }
+
+    /* grow storage, keeping the table at most half full */
+    if (nsymbols >= symbols_size) {
+        tmp = realloc(symbols, 2 * (nsymbols + 1) * sizeof(struct symbol));
+
+        if (tmp == NULL) {
+            return 0;
+        }
+
+        symbols = tmp;
+        symbols_size = 2 * (nsymbols + 1);
+    }
+
+    if (2 * (unsigned int)nsymbols >= table_mask) {
+        newmask = table_mask == 0 ? SYMBOL_TABLE_MIN - 1 : 2 * table_mask + 1;
+        newtable = calloc(newmask + 1, sizeof(int));
+
+        if (newtable == NULL) {
+            return 0;
+        }
+
+        for (i = 1; i < nsymbols; i++) {
+            for (slot = symbols[i].hash & newmask; newtable[slot] != 0; slot = (slot + 1) & newmask);
+
+            newtable[slot] = i;
+        }
+
+        free(table);
+        table = newtable;
+        table_mask = newmask;
+    }
+
+    /* add the symbol */
+    id = nsymbols;
+    symbols[id].name = strndup(str, len);
+
+    if (symbols[id].name == NULL) {
+        return 0;
+    }
+
+    symbols[id].len = len;
+    symbols[id].width = str_width(symbols[id].name, -1, NULL);
+    symbols[id].hash = hash;
+    nsymbols++;
+    ranks_valid = false;
+
+    for (slot = hash & table_mask; table[slot] != 0; slot = (slot + 1) & table_mask);
+
+    table[slot] = id;
+
+    return id;
+} /* }}} */
+
+void rank_symbols(void) { /* {{{ */
+    /* sort every symbol by name to find its rank */
+    int*    order;
+    int     i;
+
+    order = malloc(nsymbols * sizeof(int));
+
+    if (order == NULL) {
+        return;
+    }
+
+    for (i = 1; i < nsymbols; i++) {
+        order[i - 1] = i;
+    }
+
+    qsort(order, nsymbols - 1, sizeof(int), compare_symbols);
+
+    for (i = 0; i < nsymbols - 1; i++) {
+        symbols[order[i]].rank = i + 1;
+    }
+
+    free(order);
+    ranks_valid = true;
+} /* }}} */
+
+int symbol_count(void) { /* {{{ */
+    /* get the number of symbols, which is also the highest rank */
+    return nsymbols - 1;
+} /* }}} */
+
+size_t symbol_length(const int id) { /* {{{ */
+    /* get the length of a symbol, 0 for an unset symbol */
+    return id > 0 && id < nsymbols ? symbols[id].len : 0;
+} /* }}} */
+
+const char* symbol_name(const int id) { /* {{{ */
+    /* get the string of a symbol, NULL for an unset symbol */
+    return id > 0 && id < nsymbols ? symbols[id].name : NULL;
+} /* }}} */
+
+int symbol_rank(const int id) { /* {{{ */
+    /**
+     * get the sort rank of a symbol
+     * comparing the ranks of two symbols orders them like strcmp,
+     * an unset symbol ranks before all others
+     */
+    if (id <= 0 || id >= nsymbols) {
+        return 0;
+    }
+
+    if (!ranks_valid) {
+        rank_symbols();
+    }
+
+    return symbols[id].rank;
+} /* }}} */
+
+int symbol_width(const int id) { /* {{{ */
+    /* get the number of columns a symbol takes on screen, 0 for an unset symbol */
+    return id > 0 && id < nsymbols ? symbols[id].width : 0;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,636 @@
+/*
+ * taskdata.c - read Taskwarrior 2.x data files directly
+ * for tasknc
+ * by mjheagle
+ */
+
+#define _GNU_SOURCE
+#include <curses.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "json.h"
+#include "log.h"
+#include "tasks.h"
+#include "taskdata.h"
+#include "tasknc.h"
+
+/* local functions */
+static char* data_string(struct json_parser* json, const char* value, const char* end,
+                         struct arena* arena);
+static time_t data_time(const char* value, const char* end);
+static bool has_tag(const char* tags, const char* tag, const size_t len);
+static struct task* parse_data_line(struct json_parser* json, const char* line, const char* end,
+                                    struct arena* arena, const char** status, size_t* statuslen);
+static bool pending_filter(const struct data_term* terms, const int nterms);
+
+/* the directory holding pending.data, found on first use */
+static char* data_location = NULL;
+
+int compile_data_filter(const char* filter, struct data_term* terms) { /* {{{ */
+    /**
+     * split a filter into terms which can be evaluated natively
+     * filter - the task filter string
+     * terms  - the array the terms are stored in
+     * return is the number of terms, or -1 if the filter uses anything
+     * other than status, project and tag terms
+     */
+    const char* pos = filter;
+    const char* end;
+    int         n = 0;
+
+    if (filter == NULL) {
+        return 0;
+    }
+
+    while (*pos != 0) {
+        /* find the next word */
+        pos += strspn(pos, " \t");
+        end = pos + strcspn(pos, " \t");
+
+        if (end == pos) {
+            break;
+        }
+
+        if (n == MAX_DATA_TERMS) {
+            return -1;
+        }
+
+        if (end - pos == 3 && strncmp(pos, "and", 3) == 0) {
+            pos = end;
+            continue;
+        } else if (strncmp(pos, "status:", 7) == 0) {
+            terms[n].type = TERM_STATUS;
+            terms[n].value = pos + 7;
+        } else if (strncmp(pos, "project:", 8) == 0) {
+            terms[n].type = TERM_PROJECT;
+            terms[n].value = pos + 8;
+        } else if (strncmp(pos, "pro:", 4) == 0) {
+            terms[n].type = TERM_PROJECT;
+            terms[n].value = pos + 4;
+        } else if (*pos == '+' && end - pos > 1) {
+            terms[n].type = TERM_TAG;
+            terms[n].value = pos + 1;
+        } else if (*pos == '-' && end - pos > 1) {
+            terms[n].type = TERM_NOTAG;
+            terms[n].value = pos + 1;
+        } else {
+            return -1;
+        }
+
+        terms[n].len = end - terms[n].value;
+        n++;
+        pos = end;
+    }
+
+    return n;
+} /* }}} */
+
+uint64_t data_stamp(void) { /* {{{ */
+    /**
+     * summarize the modification times and sizes of the task data files
+     * return is a value which changes whenever the data files do,
+     * or 0 if no data files were found
+     */
+    static const char* const files[] = {"pending.data", "completed.data",
+                                        "taskchampion.sqlite3", "taskchampion.sqlite3-wal"
+                                       };
+    struct stat st;
+    char*       path;
+    uint64_t    stamp = 0;
+    size_t      i;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        asprintf(&path, "%s/%s", find_data_location(), files[i]);
+
+        if (stat(path, &st) == 0) {
+            stamp = (stamp ^ ((uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec)) *
+                    1099511628211ULL;
+            stamp = (stamp ^ (uint64_t)st.st_size) * 1099511628211ULL;
+        }
+
+        free(path);
+    }
+
+    return stamp;
+} /* }}} */
+
+char* data_string(struct json_parser* json, const char* value,
+                  const char* end, struct arena* arena) { /* {{{ */
+    /**
+     * decode a quoted data file value into the arena
+     * json  - parser used to decode json escapes
+     * value - the opening quote of the value
+     * end   - one past the closing quote of the value
+     * arena - the arena the string is copied into
+     * return is the decoded string
+     */
+    const char* str;
+    const char* pos;
+    size_t      len;
+    size_t      i;
+    size_t      out = 0;
+    char*       ret;
+
+    json_init(json, value, end - value);
+
+    if (!json_string(json, &str, &len)) {
+        return NULL;
+    }
+
+    /* the only entities written by taskwarrior 2.x are &open; and &close; */
+    if (memchr(str, '&', len) == NULL) {
+        return arena_strndup(arena, str, len);
+    }
+
+    ret = arena_alloc(arena, len + 1);
+
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < len; i++) {
+        pos = str + i;
+
+        if (len - i >= 6 && strncmp(pos, "&open;", 6) == 0) {
+            ret[out++] = '[';
+            i += 5;
+        } else if (len - i >= 7 && strncmp(pos, "&close;", 7) == 0) {
+            ret[out++] = ']';
+            i += 6;
+        } else if (len - i >= 7 && strncmp(pos, "&dquot;", 7) == 0) {
+            ret[out++] = '"';
+            i += 6;
+        } else {
+            ret[out++] = *pos;
+        }
+    }
+
+    ret[out] = 0;
+
+    return ret;
+} /* }}} */
+
+time_t data_time(const char* value, const char* end) { /* {{{ */
+    /* parse a quoted epoch timestamp from a data file */
+    time_t ret = 0;
+
+    for (value++; value < end && *value >= '0' && *value <= '9'; value++) {
+        ret = 10 * ret + (*value - '0');
+    }
+
+    return ret;
+} /* }}} */
+
+const char* find_data_location(void) { /* {{{ */
+    /* find the taskwarrior data directory from the environment or taskrc */
+    FILE*   rc;
+    char*   rcpath;
+    char*   line = NULL;
+    char*   value;
+    char*   location = NULL;
+    size_t  linecap = 0;
+    char*   home = getenv("HOME");
+
+    if (data_location != NULL) {
+        return data_location;
+    }
+
+    if (getenv("TASKDATA") != NULL) {
+        location = strdup(getenv("TASKDATA"));
+    } else {
+        /* look for data.location in the taskrc */
+        if (getenv("TASKRC") != NULL) {
+            rcpath = strdup(getenv("TASKRC"));
+        } else {
+            asprintf(&rcpath, "%s/.taskrc", home != NULL ? home : "");
+        }
+
+        rc = fopen(rcpath, "r");
+        free(rcpath);
+
+        while (rc != NULL && getline(&line, &linecap, rc) > 0) {
+            value = line + strspn(line, " \t");
+
+            if (!str_starts_with(value, "data.location")) {
+                continue;
+            }
+
+            value += strlen("data.location");
+            value += strspn(value, " \t");
+
+            if (*value != '=') {
+                continue;
+            }
+
+            value += 1 + strspn(value + 1, " \t");
+            value[strcspn(value, "#\r\n")] = 0;
+            value = str_trim(value);
+
+            if (value != NULL) {
+                check_free(location);
+                location = strdup(value);
+            }
+        }
+
+        if (rc != NULL) {
+            fclose(rc);
+        }
+
+        free(line);
+    }
+
+    if (location == NULL) {
+        location = strdup("~/.task");
+    }
+
+    /* expand a leading tilde */
+    if (location[0] == '~' && home != NULL) {
+        asprintf(&data_location, "%s%s", home, location + 1);
+        free(location);
+    } else {
+        data_location = location;
+    }
+
+    tnc_fprintf(logfp, LOG_DEBUG, "task data location: %s", data_location);
+
+    return data_location;
+} /* }}} */
+
+void free_data_location(void) { /* {{{ */
+    /* forget the data location so it is looked up again */
+    check_free(data_location);
+    data_location = NULL;
+} /* }}} */
+
+bool has_tag(const char* tags, const char* tag, const size_t len) { /* {{{ */
+    /* check whether a comma separated tag list contains a tag */
+    const char* pos = tags;
+
+    while (pos != NULL && *pos != 0) {
+        if (strncmp(pos, tag, len) == 0 && (pos[len] == ',' || pos[len] == 0)) {
+            return true;
+        }
+
+        pos = strchr(pos, ',');
+
+        if (pos != NULL) {
+            pos++;
+        }
+    }
+
+    return false;
+} /* }}} */
+
+bool match_data_filter(const struct data_term* terms, const int nterms,
+                       const struct task* tsk, const char* status,
+                       const size_t statuslen) { /* {{{ */
+    /* check whether a task matches every term of a filter */
+    int i;
+
+    for (i = 0; i < nterms; i++) {
+        switch (terms[i].type) {
+        case TERM_STATUS:
+            if (statuslen != terms[i].len || strncmp(status, terms[i].value, statuslen) != 0) {
+                return false;
+            }
+
+            break;
+
+        case TERM_PROJECT:
+            if (tsk->project == NULL || strncmp(tsk->project, terms[i].value, terms[i].len) != 0) {
+                return false;
+            }
+
+            break;
+
+        case TERM_TAG:
+            if (!has_tag(tsk->tags, terms[i].value, terms[i].len)) {
+                return false;
+            }
+
+            break;
+
+        case TERM_NOTAG:
+            if (has_tag(tsk->tags, terms[i].value, terms[i].len)) {
+                return false;
+            }
+
+            break;
+        }
+    }
+
+    return true;
+} /* }}} */
+
+struct task* parse_data_line(struct json_parser* json, const char* line,
+                             const char* end, struct arena* arena,
+                             const char** status, size_t* statuslen) { /* {{{ */
+    /**
+     * parse one line of a data file, formatted as [name:"value" ...]
+     * json      - parser used to decode string values
+     * line      - the start of the line
+     * end       - the end of the line
+     * arena     - the arena the task is allocated from
+     * status    - where a pointer to the raw status value will be stored
+     * statuslen - where the length of the status will be stored
+     * return is the task, or NULL if the line is malformed
+     */
+    const char*     pos = line;
+    const char*     name;
+    const char*     value;
+    size_t          namelen;
+    struct task*    tsk;
+
+    if (pos >= end || *pos != '[') {
+        return NULL;
+    }
+
+    tsk = malloc_task(arena);
+
+    if (tsk == NULL) {
+        return NULL;
+    }
+
+    *status = "pending";
+    *statuslen = 7;
+    pos++;
+
+    while (pos < end) {
+        /* read the attribute name */
+        pos += strspn(pos, " ");
+        name = pos;
+
+        while (pos < end && *pos != ':' && *pos != ']') {
+            pos++;
+        }
+
+        if (pos + 1 >= end || *pos != ':' || pos[1] != '"') {
+            break;
+        }
+
+        namelen = pos - name;
+        value = ++pos;
+
+        /* find the closing quote of the value */
+        for (pos++; pos < end && *pos != '"'; pos++) {
+            if (*pos == '\\') {
+                pos++;
+            }
+        }
+
+        if (pos >= end) {
+            break;
+        }
+
+        pos++;
+
+        /* store the attributes tasknc uses */
+        switch (namelen) {
+        case 3:
+            if (strncmp(name, "due", 3) == 0) {
+                tsk->due = data_time(value, pos);
+            } else if (strncmp(name, "end", 3) == 0) {
+                tsk->end = data_time(value, pos);
+            }
+
+            break;
+
+        case 4:
+            if (strncmp(name, "uuid", 4) == 0) {
+                tsk->uuid = data_string(json, value, pos, arena);
+            } else if (strncmp(name, "tags", 4) == 0) {
+                tsk->tags = data_string(json, value, pos, arena);
+            }
+
+            break;
+
+        case 5:
+            if (strncmp(name, "entry", 5) == 0) {
+                tsk->entry = data_time(value, pos);
+            } else if (strncmp(name, "start", 5) == 0) {
+                tsk->start = data_time(value, pos);
+            }
+
+            break;
+
+        case 6:
+            if (strncmp(name, "status", 6) == 0) {
+                *status = value + 1;
+                *statuslen = pos - value - 2;
+            }
+
+            break;
+
+        case 7:
+            if (strncmp(name, "project", 7) == 0) {
+                tsk->project = data_string(json, value, pos, arena);
+            }
+
+            break;
+
+        case 8:
+            if (strncmp(name, "priority", 8) == 0) {
+                tsk->priority = value[1] != '"' ? value[1] : 0;
+            } else if (strncmp(name, "modified", 8) == 0) {
+                tsk->modified = data_time(value, pos);
+            }
+
+            break;
+
+        case 11:
+            if (strncmp(name, "description", 11) == 0) {
+                tsk->description = data_string(json, value, pos, arena);
+            }
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (tsk->uuid == NULL || tsk->description == NULL) {
+        return NULL;
+    }
+
+    intern_task(tsk, arena);
+
+    return tsk;
+} /* }}} */
+
+bool pending_filter(const struct data_term* terms, const int nterms) { /* {{{ */
+    /**
+     * check whether a filter only matches tasks kept in pending.data
+     * terms  - the compiled filter
+     * nterms - the number of terms
+     * return is true if a status term limits it to pending, waiting or
+     * recurring tasks, completed and deleted tasks being moved to
+     * completed.data by a garbage collection
+     */
+    static const char* const statuses[] = {"pending", "waiting", "recurring"};
+    size_t  i;
+    int     n;
+
+    for (n = 0; n < nterms; n++) {
+        if (terms[n].type != TERM_STATUS) {
+            continue;
+        }
+
+        for (i = 0; i < sizeof(statuses) / sizeof(statuses[0]); i++) {
+            if (terms[n].len == strlen(statuses[i]) &&
+                strncmp(terms[n].value, statuses[i], terms[n].len) == 0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+} /* }}} */
+
+bool read_data_file(const char* filter, const char* uuid,
+                    struct arena* arena, struct task** tasks,
+                    time_t* modified) { /* {{{ */
+    /**
+     * read the tasks matching a filter from pending.data
+     * filter   - the filter to apply
+     * uuid     - a single task to read, or NULL for every matching task
+     * arena    - the arena the tasks are allocated from
+     * tasks    - where the first task of the list read will be stored
+     * modified - where the latest modification time seen will be stored
+     * return is false if the data file could not be read or the filter
+     * cannot be evaluated, in which case task export must be used instead
+     */
+    struct data_term    terms[MAX_DATA_TERMS];
+    struct json_parser  json;
+    struct stat         st;
+    struct task*        this;
+    struct task*        last = NULL;
+    const char*         map;
+    const char*         line;
+    const char*         end;
+    const char*         status;
+    size_t              statuslen;
+    char*               path;
+    char                needle[UUIDLENGTH + 8];
+    unsigned short      id = 0;
+    int                 nterms;
+    int                 fd;
+    int                 count = 0;
+
+    *tasks = NULL;
+    nterms = compile_data_filter(filter, terms);
+
+    if (nterms < 0 || !pending_filter(terms, nterms)) {
+        tnc_fprintf(logfp, LOG_DEBUG, "filter cannot be read from data files: %s", filter);
+        return false;
+    }
+
+    /* map the data file */
+    asprintf(&path, "%s/pending.data", find_data_location());
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not open data file %s", path);
+        free(path);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return false;
+    }
+
+    free(path);
+
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not map data file");
+        return false;
+    }
+
+    madvise((void*)map, st.st_size, MADV_SEQUENTIAL);
+
+    if (uuid != NULL) {
+        snprintf(needle, sizeof(needle), "uuid:\"%s\"", uuid);
+    }
+
+    memset(&json, 0, sizeof(json));
+
+    for (line = map; line < map + st.st_size; line = end + 1) {
+        end = memchr(line, '\n', map + st.st_size - line);
+
+        if (end == NULL) {
+            end = map + st.st_size;
+        }
+
+        /* a single task is found by its uuid, the others are only
+         * scanned for their status to keep track of ids */
+        if (uuid != NULL && memmem(line, end - line, needle, strlen(needle)) == NULL) {
+            status = memmem(line, end - line, "status:\"", 8);
+
+            if (status == NULL || (strncmp(status + 8, "completed\"", 10) != 0 &&
+                                   strncmp(status + 8, "deleted\"", 8) != 0)) {
+                id++;
+            }
+
+            continue;
+        }
+
+        this = parse_data_line(&json, line, end, arena, &status, &statuslen);
+
+        if (this == NULL) {
+            if (end > line) {
+                tnc_fprintf(logfp, LOG_ERROR, "malformed data line: %.*s", (int)(end - line), line);
+            }
+
+            continue;
+        }
+
+        /* completed and deleted tasks waiting for gc do not have ids */
+        if ((statuslen != 9 || strncmp(status, "completed", 9) != 0) &&
+            (statuslen != 7 || strncmp(status, "deleted", 7) != 0)) {
+            this->index = ++id;
+        }
+
+        if (!match_data_filter(terms, nterms, this, status, statuslen)) {
+            continue;
+        }
+
+        if (this->modified > *modified) {
+            *modified = this->modified;
+        }
+
+        /* set pointers */
+        this->prev = last;
+
+        if (last == NULL) {
+            *tasks = this;
+        } else {
+            last->next = this;
+        }
+
+        last = this;
+        count++;
+    }
+
+    json_free(&json);
+    munmap((void*)map, st.st_size);
+
+    tnc_fprintf(logfp, LOG_DEBUG, "read %d tasks from %s/pending.data", count, data_location);
+
+    return true;
+} /* }}} */
+
+// vim: et ts=4 sw=4 sts=4
@@ -0,0 +1,389 @@
+/*
+ * taskdb.c - read Taskwarrior 3.x TaskChampion databases directly
+ * for tasknc
+ * by mjheagle
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+#include "log.h"
+#include "taskdata.h"
+#include "taskdb.h"
+#include "tasks.h"
+
+#ifdef HAVE_SQLITE
+#include <sqlite3.h>
+
+/* the longest status kept while filtering */
+#define TASK_STATUS_LENGTH              16
+
+/* how long to wait for a task command holding the database lock in ms */
+#define TASK_DB_TIMEOUT                 250
+
+/* every task along with its working set id */
+#define TASK_DB_QUERY                   "SELECT tasks.uuid, tasks.data, working_set.id " \
+                                        "FROM tasks LEFT JOIN working_set " \
+                                        "ON working_set.uuid = tasks.uuid"
+
+/* local functions */
+static bool append_tag(char** tags, size_t* taglen, size_t* tagsize,
+                       const char* tag, const size_t len);
+static time_t db_time(const char* value, const size_t len);
+static bool open_task_db(void);
+static struct task* parse_db_row(sqlite3_stmt* stmt, struct json_parser* json,
+                                 struct arena* arena, char* status, char** tags,
+                                 size_t* tagsize);
+
+/* the open database and its statements, kept for the next reload */
+static sqlite3*         db = NULL;
+static sqlite3_stmt*    all_stmt = NULL;
+static sqlite3_stmt*    uuid_stmt = NULL;
+
+bool append_tag(char** tags, size_t* taglen, size_t* tagsize,
+                const char* tag, const size_t len) { /* {{{ */
+    /* add a tag to a comma separated tag list being built */
+    char* tmp;
+
+    if (*taglen + len + 2 > *tagsize) {
+        tmp = realloc(*tags, 2 * (*taglen + len + 2));
+
+        if (tmp == NULL) {
+            return false;
+        }
+
+        *tags = tmp;
+        *tagsize = 2 * (*taglen + len + 2);
+    }
+
+    if (*taglen > 0) {
+        (*tags)[(*taglen)++] = ',';
+    }
+
+    memcpy(*tags + *taglen, tag, len);
+    *taglen += len;
+
+    return true;
+} /* }}} */
+
+void close_task_db(void) { /* {{{ */
+    /* finalize statements and close the database */
+    sqlite3_finalize(all_stmt);
+    sqlite3_finalize(uuid_stmt);
+    sqlite3_close(db);
+    all_stmt = NULL;
+    uuid_stmt = NULL;
+    db = NULL;
+} /* }}} */
+
+time_t db_time(const char* value, const size_t len) { /* {{{ */
+    /* parse an epoch timestamp stored as a string */
+    time_t  ret = 0;
+    size_t  i;
+
+    for (i = 0; i < len && value[i] >= '0' && value[i] <= '9'; i++) {
+        ret = 10 * ret + (value[i] - '0');
+    }
+
+    return ret;
+} /* }}} */
+
+bool open_task_db(void) { /* {{{ */
+    /* open the task database read only and prepare statements */
+    char*   path;
+    int     ret;
+
+    if (db != NULL) {
+        return true;
+    }
+
+    asprintf(&path, "%s/taskchampion.sqlite3", find_data_location());
+    ret = sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL);
+
+    if (ret != SQLITE_OK) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not open task database %s: %s",
+                    path, sqlite3_errmsg(db));
+        free(path);
+        close_task_db();
+        return false;
+    }
+
+    tnc_fprintf(logfp, LOG_DEBUG, "opened task database %s", path);
+    free(path);
+    sqlite3_busy_timeout(db, TASK_DB_TIMEOUT);
+
+    if (sqlite3_prepare_v2(db, TASK_DB_QUERY, -1, &all_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, TASK_DB_QUERY " WHERE tasks.uuid = ?", -1,
+                           &uuid_stmt, NULL) != SQLITE_OK) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not prepare task query: %s", sqlite3_errmsg(db));
+        close_task_db();
+        return false;
+    }
+
+    return true;
+} /* }}} */
+
+struct task* parse_db_row(sqlite3_stmt* stmt, struct json_parser* json,
+                          struct arena* arena, char* status, char** tags,
+                          size_t* tagsize) { /* {{{ */
+    /**
+     * decode a row of the tasks table
+     * stmt    - the statement positioned at the row
+     * json    - parser used to decode the task data
+     * arena   - the arena the task is allocated from
+     * status  - where the status is copied, which must hold TASK_STATUS_LENGTH bytes
+     * tags    - scratch buffer the tag list is built in
+     * tagsize - the allocated size of tags
+     * return is the task, or NULL if the row is malformed
+     */
+    struct task*    tsk;
+    const char*     key;
+    const char*     str;
+    size_t          keylen;
+    size_t          len;
+    size_t          taglen = 0;
+    char**          field;
+    time_t*         date;
+    char*           chr;
+    int             ret;
+
+    tsk = malloc_task(arena);
+
+    if (tsk == NULL) {
+        return NULL;
+    }
+
+    tsk->uuid = arena_strndup(arena, (const char*)sqlite3_column_text(stmt, 0),
+                              sqlite3_column_bytes(stmt, 0));
+    tsk->index = sqlite3_column_int(stmt, 2);
+    *status = 0;
+
+    json_init(json, (const char*)sqlite3_column_text(stmt, 1), sqlite3_column_bytes(stmt, 1));
+
+    if (!json_object_begin(json)) {
+        return NULL;
+    }
+
+    /* every property is a string, dispatch on the length of its name */
+    while ((ret = json_next_member(json, &key, &keylen)) == 1) {
+        field = NULL;
+        date = NULL;
+        chr = NULL;
+
+        /* tags are stored as tag_<name> properties with empty values */
+        if (keylen > 4 && memcmp(key, "tag_", 4) == 0) {
+            if (!append_tag(tags, &taglen, tagsize, key + 4, keylen - 4) || !json_skip(json)) {
+                return NULL;
+            }
+
+            continue;
+        }
+
+        switch (keylen) {
+        case 3:
+            if (memcmp(key, "due", 3) == 0) {
+                date = &(tsk->due);
+            } else if (memcmp(key, "end", 3) == 0) {
+                date = &(tsk->end);
+            }
+
+            break;
+
+        case 5:
+            if (memcmp(key, "entry", 5) == 0) {
+                date = &(tsk->entry);
+            } else if (memcmp(key, "start", 5) == 0) {
+                date = &(tsk->start);
+            }
+
+            break;
+
+        case 6:
+            if (memcmp(key, "status", 6) == 0) {
+                chr = status;
+            }
+
+            break;
+
+        case 7:
+            if (memcmp(key, "project", 7) == 0) {
+                field = &(tsk->project);
+            }
+
+            break;
+
+        case 8:
+            if (memcmp(key, "priority", 8) == 0) {
+                chr = &(tsk->priority);
+            } else if (memcmp(key, "modified", 8) == 0) {
+                date = &(tsk->modified);
+            }
+
+            break;
+
+        case 11:
+            if (memcmp(key, "description", 11) == 0) {
+                field = &(tsk->description);
+            }
+
+            break;
+
+        default:
+            break;
+        }
+
+        if ((field == NULL && date == NULL && chr == NULL) || json_peek(json) != JSON_STRING) {
+            if (!json_skip(json)) {
+                return NULL;
+            }
+
+            continue;
+        }
+
+        if (!json_string(json, &str, &len)) {
+            return NULL;
+        }
+
+        if (date != NULL) {
+            *date = db_time(str, len);
+        } else if (chr == status) {
+            len = len < TASK_STATUS_LENGTH - 1 ? len : TASK_STATUS_LENGTH - 1;
+            memcpy(status, str, len);
+            status[len] = 0;
+        } else if (chr != NULL) {
+            *chr = len > 0 ? *str : 0;
+        } else {
+            *field = arena_strndup(arena, str, len);
+        }
+    }
+
+    if (ret < 0) {
+        return NULL;
+    }
+
+    if (taglen > 0) {
+        tsk->tags = arena_strndup(arena, *tags, taglen);
+    }
+
+    intern_task(tsk, arena);
+
+    return tsk;
+} /* }}} */
+
+bool read_task_db(const char* filter, const char* uuid,
+                  struct arena* arena, struct task** tasks,
+                  time_t* modified) { /* {{{ */
+    /**
+     * read the tasks matching a filter from the task database
+     * filter   - the filter to apply
+     * uuid     - a single task to read, or NULL for every matching task
+     * arena    - the arena the tasks are allocated from
+     * tasks    - where the first task of the list read will be stored
+     * modified - where the latest modification time seen will be stored
+     * return is false if the database could not be read or the filter
+     * cannot be evaluated, in which case task export must be used instead
+     */
+    struct data_term    terms[MAX_DATA_TERMS];
+    struct json_parser  json;
+    struct task*        this;
+    struct task*        last = NULL;
+    sqlite3_stmt*       stmt;
+    char                status[TASK_STATUS_LENGTH];
+    char*               tags = NULL;
+    size_t              tagsize = 0;
+    int                 nterms;
+    int                 ret;
+    int                 count = 0;
+
+    *tasks = NULL;
+    nterms = compile_data_filter(filter, terms);
+
+    if (nterms < 0) {
+        tnc_fprintf(logfp, LOG_DEBUG, "filter cannot be read from task database: %s", filter);
+        return false;
+    }
+
+    if (!open_task_db()) {
+        return false;
+    }
+
+    /* a single task is looked up by its primary key */
+    if (uuid != NULL) {
+        stmt = uuid_stmt;
+        sqlite3_bind_text(stmt, 1, uuid, -1, SQLITE_STATIC);
+    } else {
+        stmt = all_stmt;
+    }
+
+    memset(&json, 0, sizeof(json));
+
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        this = parse_db_row(stmt, &json, arena, status, &tags, &tagsize);
+
+        if (this == NULL || this->uuid == NULL || this->description == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "malformed task in database: %s",
+                        sqlite3_column_text(stmt, 0));
+            continue;
+        }
+
+        if (!match_data_filter(terms, nterms, this, status, strlen(status))) {
+            continue;
+        }
+
+        if (this->modified > *modified) {
+            *modified = this->modified;
+        }
+
+        /* set pointers */
+        this->prev = last;
+
+        if (last == NULL) {
+            *tasks = this;
+        } else {
+            last->next = this;
+        }
+
+        last = this;
+        count++;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    json_free(&json);
+    free(tags);
+
+    if (ret != SQLITE_DONE) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not read task database: %s", sqlite3_errmsg(db));
+        *tasks = NULL;
+        return false;
+    }
+
+    tnc_fprintf(logfp, LOG_DEBUG, "read %d tasks from task database", count);
+
+    return true;
+} /* }}} */
+
+#else
+
+void close_task_db(void) { /* {{{ */
+    /* nothing is opened without sqlite support */
+} /* }}} */
+
+bool read_task_db(const char* filter, const char* uuid,
+                  struct arena* arena, struct task** tasks,
+                  time_t* modified) { /* {{{ */
+    /* without sqlite support task export is always used */
+    (void)filter;
+    (void)uuid;
+    (void)arena;
+    (void)modified;
+    *tasks = NULL;
+    tnc_fprintf(logfp, LOG_ERROR, "tasknc was built without sqlite support");
+
+    return false;
+} /* }}} */
+
+#endif
+
+// vim: et ts=4 sw=4 sts=4
@@ -9,17 +9,21 @@
 #define _GNU_SOURCE
 
 #include <curses.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <wchar.h>
 #include "color.h"
 #include "common.h"
 #include "config.h"
 #include "formats.h"
 #include "keys.h"
 #include "log.h"
+#include "schedule.h"
 #include "sort.h"
 #include "statusbar.h"
 #include "tasklist.h"
@@ -27,10 +31,137 @@
 #include "tasks.h"
 #include "pager.h"
 
+/* the number of rendered task lines kept, a power of two */
+#define LINE_CACHE_SIZE                 256
+
+/**
+ * task line struct - a task line as it was last rendered
+ * version    - the version of the task rendered, 0 for an unused line
+ * generation - the line generation the task was rendered in
+ * text       - the wide characters of the left aligned part of the line,
+ *              followed by those of the right aligned part
+ * left       - the number of characters in the left part
+ * right      - the number of characters in the right part
+ * rightx     - the column the right part is drawn at
+ * size       - the number of characters text has room for
+ */
+struct task_line {
+    unsigned long version;
+    unsigned long generation;
+    wchar_t* text;
+    int left;
+    int right;
+    int rightx;
+    int size;
+};
+
 /* local functions */
+static void check_line_cache(void);
+static void check_schedule(void);
+static bool format_cacheable(const struct format* fmt);
+static void precompute_colors(void);
+static struct task_line* render_task_line(const struct task* tsk);
 void tasklist_command_message(const int ret,
                               const char* fail,
                               const char* success);
+int tasklist_getch(void);
+void tasklist_reload(void);
+void tasklist_reloaded(void);
+
+/* the task to select once a reload finishes */
+static char* reload_uuid = NULL;
+
+/* rendered task lines, indexed by task version */
+static struct task_line line_cache[LINE_CACHE_SIZE];
+
+/* the buffer the task format is evaluated into */
+static char* line_buf = NULL;
+static size_t line_bufsize = 0;
+
+/* what the cached lines were rendered with, a change to any of which
+ * starts a new generation of lines */
+static unsigned long line_generation = 1;
+static struct format* line_format = NULL;
+static bool line_format_cacheable = false;
+static int line_cols = -1;
+static int line_project = -1;
+static int line_day = -1;
+static time_t line_checked = 0;
+
+void check_line_cache(void) { /* {{{ */
+    /* expire the rendered task lines if anything they depend on changed */
+    struct tm*  now;
+    time_t      cur = time(NULL);
+    int         day = line_day;
+
+    /* dates are shown without the year within the current year */
+    if (cur != line_checked) {
+        now = localtime(&cur);
+        day = now->tm_year * 366 + now->tm_yday;
+        line_checked = cur;
+    }
+
+    /* a new day could change which color rules match */
+    if (line_day != day && line_day != -1) {
+        expire_colors();
+    }
+
+    if (line_format != cfg.formats.task_compiled || line_cols != cols ||
+        line_project != cfg.fieldlengths.project || line_day != day) {
+        if (line_format != cfg.formats.task_compiled) {
+            line_format = cfg.formats.task_compiled;
+            line_format_cacheable = format_cacheable(line_format);
+        }
+
+        line_cols = cols;
+        line_project = cfg.fieldlengths.project;
+        line_day = day;
+        line_generation++;
+    }
+} /* }}} */
+
+void check_schedule(void) { /* {{{ */
+    /* recolor the tasks which became due soon or overdue since last checked,
+     * repainting only those which are visible */
+    struct task*    tsk;
+    int             pos;
+
+    while (schedule_pop(time(NULL), &tsk)) {
+        if (tsk == NULL) {
+            expire_colors();
+            redraw = true;
+            continue;
+        }
+
+        /* the line text does not change, only its color */
+        tsk->colorgen = 0;
+
+        if (redraw) {
+            continue;
+        }
+
+        pos = get_task_position_by_uuid(tsk->uuid);
+
+        if (pos >= pageoffset && pos < pageoffset + rows - 2 &&
+            get_task_by_position(pos) == tsk) {
+            tasklist_print_task(pos, tsk, 1);
+        }
+    }
+} /* }}} */
+
+bool format_cacheable(const struct format* fmt) { /* {{{ */
+    /* check whether a format depends only on the task and the date,
+     * so that its result can be kept until either changes */
+    int i;
+
+    for (i = 0; fmt != NULL && i < fmt->nfields; i++) {
+        if (fmt->fields[i].type == FIELD_TIME || fmt->fields[i].type == FIELD_VAR) {
+            return false;
+        }
+    }
+
+    return true;
+} /* }}} */
 
 void key_tasklist_add(void) { /* {{{ */
     /* handle a keyboard direction to add new task */
@@ -140,8 +271,8 @@ void key_tasklist_scroll(const int direction) { /* {{{ */
      *             h = to first element in list
      *             e = to last element in list
      */
-    const char oldsel    = selline;
-    const char oldoffset = pageoffset;
+    const int oldsel    = selline;
+    const int oldoffset = pageoffset;
 
     switch (direction) {
     case 'u':
@@ -195,7 +326,14 @@ void key_tasklist_scroll(const int direction) { /* {{{ */
         break;
     }
 
-    if (pageoffset != oldoffset) {
+    if (pageoffset - oldoffset == 1 || oldoffset - pageoffset == 1) {
+        /* shift the visible lines and draw only the two that changed */
+        scrollok(tasklist, TRUE);
+        wscrl(tasklist, pageoffset - oldoffset);
+        scrollok(tasklist, FALSE);
+        tasklist_print_task(oldsel, NULL, 1);
+        tasklist_print_task(selline, NULL, 1);
+    } else if (pageoffset != oldoffset) {
         redraw = true;
     } else {
         if (oldsel - selline == 1) {
@@ -288,7 +426,8 @@ void key_tasklist_sort(const char* arg) { /* {{{ */
     }
 
     /* run sort */
-    sort_wrapper(head);
+    head = sort_wrapper(head);
+    task_count();
 
     /* follow original task */
     if (cfg.follow_task) {
@@ -312,6 +451,7 @@ void key_tasklist_sync(void) { /* {{{ */
 
     if (ret == 0) {
         statusbar_message(cfg.statusbar_timeout, "tasks synchronized");
+        expire_tasks();
         reload = true;
     } else {
         statusbar_message(cfg.statusbar_timeout, "task syncronization failed");
@@ -349,8 +489,7 @@ void key_tasklist_toggle_started(void) { /* {{{ */
         actionpast = started ? "stopped" : "started";
         asprintf(&reply, "task %s", actionpast);
         /* reset cached colors */
-        cur->pair = -1;
-        cur->selpair = -1;
+        cur->colorgen = 0;
     } else {
         asprintf(&reply, "task%s failed (%d)", action, WEXITSTATUS(ret));
     }
@@ -365,6 +504,7 @@ void key_tasklist_undo(void) { /* {{{ */
 
     if (ret == 0) {
         statusbar_message(cfg.statusbar_timeout, "undo executed");
+        expire_tasks();
         reload = true;
     } else {
         statusbar_message(cfg.statusbar_timeout, "undo execution failed (%d)", ret);
@@ -378,6 +518,86 @@ void key_tasklist_view(void) { /* {{{ */
     view_task(get_task_by_position(selline));
 } /* }}} */
 
+void precompute_colors(void) { /* {{{ */
+    /* color the page of tasks on either side of the visible ones, so that
+     * scrolling onto them finds their colors cached */
+    struct task*    this;
+    const int       page = rows - 2;
+    int             pos = pageoffset > page ? pageoffset - page : 0;
+
+    for (this = get_task_by_position(pos); this != NULL && pos < pageoffset + 2 * page;
+         this = this->next, pos++) {
+        if (pos < pageoffset || pos >= pageoffset + page) {
+            get_colors(OBJECT_TASK, this, false);
+        }
+    }
+} /* }}} */
+
+struct task_line* render_task_line(const struct task* tsk) { /* {{{ */
+    /**
+     * get the rendering of a task line, evaluating the task format only if
+     * the task or anything else the line depends on changed since
+     * tsk - the task to render
+     * return is the rendered line
+     */
+    struct task_line*   line = &line_cache[tsk->version & (LINE_CACHE_SIZE - 1)];
+    wchar_t*            text;
+    char*               str;
+    char*               right;
+    size_t              len;
+    int                 width;
+
+    if (line->version == tsk->version && line->generation == line_generation &&
+        line_format_cacheable) {
+        return line;
+    }
+
+    str = eval_format(cfg.formats.task_compiled, tsk, &line_buf, &line_bufsize);
+    line->version = 0;
+    line->left = 0;
+    line->right = 0;
+
+    if (str == NULL) {
+        return line;
+    }
+
+    /* split at the alignment break */
+    right = strstr(str, "$>");
+
+    if (right != NULL) {
+        *right = 0;
+        right += 2;
+    }
+
+    /* a character takes at least a byte, so this is enough room */
+    len = strlen(str) + (right != NULL ? strlen(right) : 0) + 1;
+
+    if ((int)len > line->size) {
+        text = realloc(line->text, len * sizeof(wchar_t));
+
+        if (text == NULL) {
+            return line;
+        }
+
+        line->text = text;
+        line->size = len;
+    }
+
+    /* convert each part, cutting the left one off at the edge of the window */
+    line->left = str_to_wide(str, line->text, cols, NULL);
+
+    if (right != NULL) {
+        width = str_width(right, -1, NULL);
+        line->rightx = cols - width;
+        line->right = line->rightx < 0 ? 0 : str_to_wide(right, line->text + line->left, width, NULL);
+    }
+
+    line->version = tsk->version;
+    line->generation = line_generation;
+
+    return line;
+} /* }}} */
+
 void tasklist_check_curs_pos(void) { /* {{{ */
     /* check if the cursor is in a valid position */
     const int onscreentasks = getmaxy(tasklist);
@@ -433,11 +653,78 @@ void tasklist_command_message(const int ret,
     }
 } /* }}} */
 
+void tasklist_free_line_cache(void) { /* {{{ */
+    /* release the rendered task lines */
+    int i;
+
+    for (i = 0; i < LINE_CACHE_SIZE; i++) {
+        free(line_cache[i].text);
+    }
+
+    memset(line_cache, 0, sizeof(line_cache));
+    free(line_buf);
+    line_buf = NULL;
+    line_bufsize = 0;
+} /* }}} */
+
+int tasklist_getch(void) { /* {{{ */
+    /* get a character, reading the output of a background load while waiting
+     * return is the character read, or ERR if none was
+     */
+    struct pollfd   fds[2];
+    int             c;
+
+    /* check for input ncurses has already buffered, using the time before
+     * the next key otherwise */
+    if (head != NULL) {
+        wtimeout(statusbar, 0);
+        c = wgetch(statusbar);
+        wtimeout(statusbar, cfg.nc_timeout);
+
+        if (c != ERR) {
+            return c;
+        }
+
+        precompute_colors();
+    }
+
+    if (tasks_loading_fd() < 0) {
+        return wgetch(statusbar);
+    }
+
+    /* wait for either a key or task output, only reading keys once there
+     * are tasks for them to act on */
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = tasks_loading_fd();
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    poll(fds + (head == NULL ? 1 : 0), head == NULL ? 1 : 2, cfg.nc_timeout);
+
+    if (fds[1].revents != 0 && read_tasks_background()) {
+        redraw = true;
+
+        if (tasks_loading_fd() < 0) {
+            tasklist_reloaded();
+        }
+    }
+
+    if (head == NULL || fds[0].revents == 0) {
+        return ERR;
+    }
+
+    wtimeout(statusbar, 0);
+    c = wgetch(statusbar);
+    wtimeout(statusbar, cfg.nc_timeout);
+
+    return c;
+} /* }}} */
+
 void tasklist_window(void) { /* {{{ */
     /* ncurses main function */
     int             c;
-    struct task*    cur;
-    char*           uuid = NULL;
+    bool            reload_queued = false;
 
     /* get field lengths */
     cfg.fieldlengths.project = max_project_length();
@@ -460,6 +747,9 @@ void tasklist_window(void) { /* {{{ */
         ncurses_end(-1);
     }
 
+    /* let the terminal scroll the task list by inserting and deleting lines */
+    idlok(tasklist, TRUE);
+
     /* set curses settings */
     set_curses_mode(NCURSES_MODE_STD);
 
@@ -479,7 +769,7 @@ void tasklist_window(void) { /* {{{ */
         reload  = false;
 
         /* check for an empty task list */
-        if (head == NULL) {
+        if (head == NULL && tasks_loading_fd() < 0) {
             if (strcmp(active_filter, "") == 0) {
                 tnc_fprintf(logfp, LOG_ERROR,
                             "it appears that your task list is empty. %s does not yet support empty task lists.",
@@ -505,7 +795,7 @@ void tasklist_window(void) { /* {{{ */
         doupdate();
 
         /* get a character */
-        c = wgetch(statusbar);
+        c = tasklist_getch();
 
         /* handle the character */
         handle_keypress(c, MODE_TASKLIST);
@@ -515,33 +805,24 @@ void tasklist_window(void) { /* {{{ */
             break;
         }
 
-        /* reload task list */
-        if (reload) {
-            cur = get_task_by_position(selline);
+        /* reload task list, waiting for a reload in progress to finish */
+        if (reload || reload_queued) {
+            reload_queued = tasks_loading_fd() >= 0;
 
-            if (cur) {
-                uuid = strdup(cur->uuid);
+            if (!reload_queued) {
+                tasklist_reload();
             }
-
-            wipe_tasklist();
-            reload_tasks();
-            task_count();
-            redraw = true;
-
-            if (cfg.follow_task) {
-                set_position_by_uuid(uuid);
-            }
-
-            check_free(uuid);
-            uuid = NULL;
-            tasklist_check_curs_pos();
         }
 
+        /* recolor tasks whose due dates were reached */
+        check_schedule();
+
         /* redraw all windows */
         if (redraw) {
             cfg.fieldlengths.project = max_project_length();
             cfg.fieldlengths.description = cols - cfg.fieldlengths.project - 1 -
                                            cfg.fieldlengths.date;
+            expire_header();
             print_header();
             tasklist_print_task_list();
             tasklist_check_curs_pos();
@@ -568,12 +849,11 @@ void tasklist_print_task(const int tasknum,
      *           only one of either `tasknum` or `this` should be specified
      * count   - number of consecutive tasks to print
      */
-    bool  sel = false;
-    char* tmp;
-    int   x;
-    int   y = tasknum - pageoffset; /* determine position to print */
+    struct task_line*   line;
+    bool                sel = false;
+    int                 y = tasknum - pageoffset; /* determine position to print */
 
-    if (y < 0 || y >= rows - 1) {
+    if (y < 0 || y >= rows - 2) {
         return;
     }
 
@@ -593,19 +873,19 @@ void tasklist_print_task(const int tasknum,
         sel = true;
     }
 
-    /* wipe line */
-    wattrset(tasklist, COLOR_PAIR(0));
+    /* print line, the color is cached in the task */
+    check_line_cache();
+    line = render_task_line(this);
+    wattrset(tasklist, get_colors(OBJECT_TASK, (struct task*)this, sel));
+    mvwhline(tasklist, y, 0, ' ', cols);
 
-    for (x = 0; x < cols; x++) {
-        mvwaddch(tasklist, y, x, ' ');
+    if (line->left > 0) {
+        mvwaddnwstr(tasklist, y, 0, line->text, line->left);
     }
 
-    /* evaluate line */
-    wmove(tasklist, 0, 0);
-    wattrset(tasklist, get_colors(OBJECT_TASK, (struct task*)this, sel));
-    tmp = (char*)eval_format(cfg.formats.task_compiled, (struct task*)this);
-    umvaddstr_align(tasklist, y, tmp);
-    free(tmp);
+    if (line->right > 0) {
+        mvwaddnwstr(tasklist, y, line->rightx, line->text + line->left, line->right);
+    }
 
     /* print next task if requested */
     if (count > 1) {
@@ -616,23 +896,50 @@ void tasklist_print_task(const int tasknum,
 } /* }}} */
 
 void tasklist_print_task_list(void) { /* {{{ */
-    /* print every task in the task list */
-    struct task* cur     = head;
-    short        counter = 0;
+    /* print the tasks which are visible in the task list window */
+    struct task* cur   = get_task_by_position(pageoffset);
+    const int    lines = rows - 2;
+    int          counter;
 
-    while (cur != NULL) {
-        tasklist_print_task(counter, cur, 1);
-
-        /* move to next item */
-        counter++;
+    for (counter = 0; counter < lines && cur != NULL; counter++) {
+        tasklist_print_task(pageoffset + counter, cur, 1);
         cur = cur->next;
     }
 
-    if (counter < cols - 2) {
-        wipe_screen(tasklist, counter - pageoffset, rows - 2);
+    /* clear the lines below the last task */
+    if (counter < lines) {
+        wipe_screen(tasklist, counter, lines - 1);
+    }
+} /* }}} */
+
+void tasklist_reload(void) { /* {{{ */
+    /* start reloading the task list, remembering the selected task */
+    struct task* cur = get_task_by_position(selline);
+
+    check_free(reload_uuid);
+    reload_uuid = cur != NULL ? strdup(cur->uuid) : NULL;
+
+    if (!reload_tasks_background()) {
+        tasklist_reloaded();
+    } else {
+        statusbar_message(cfg.statusbar_timeout, "loading tasks...");
     }
 } /* }}} */
 
+void tasklist_reloaded(void) { /* {{{ */
+    /* update the tasklist after a reload has finished */
+    wipe_tasklist();
+    redraw = true;
+
+    if (cfg.follow_task) {
+        set_position_by_uuid(reload_uuid);
+    }
+
+    check_free(reload_uuid);
+    reload_uuid = NULL;
+    tasklist_check_curs_pos();
+} /* }}} */
+
 void tasklist_remove_task(struct task* this) { /* {{{ */
     /* remove a task from the task list without reloading */
     if (this == head) {
@@ -645,8 +952,7 @@ void tasklist_remove_task(struct task* this) { /* {{{ */
         this->next->prev = this->prev;
     }
 
-    free_task(this);
-    taskcount--;
+    unindex_task(this);
     tasklist_check_curs_pos();
     redraw = true;
 } /* }}} */
@@ -22,11 +22,16 @@
 #include "formats.h"
 #include "tasknc.h"
 #include "tasklist.h"
+#include "taskdata.h"
+#include "taskdb.h"
 #include "tasks.h"
 #include "log.h"
 #include "keys.h"
 #include "pager.h"
+#include "schedule.h"
+#include "sort.h"
 #include "statusbar.h"
+#include "symbols.h"
 #include "test.h"
 
 /* global variables {{{ */
@@ -58,25 +63,35 @@ WINDOW* statusbar   = NULL;
 WINDOW* pager       = NULL;
 /* }}} */
 
+/* whether the header must be drawn even if nothing it shows changed */
+static bool header_expired = true;
+
 /* user-exposed variables & functions {{{ */
 struct var vars[] = {
     {"curs_timeout",      VAR_INT,  VAR_RC, &(cfg.nc_timeout)},
+    {"due_soon",          VAR_INT,  VAR_RW, &(cfg.due_soon)},
     {"filter_string",     VAR_STR,  VAR_RW, &active_filter},
     {"follow_task",       VAR_INT,  VAR_RW, &(cfg.follow_task)},
     {"history_max",       VAR_INT,  VAR_RC, &(cfg.history_max)},
+    {"incremental_reload", VAR_INT, VAR_RW, &(cfg.incremental)},
     {"log_level",         VAR_INT,  VAR_RW, &(cfg.loglvl)},
     {"program_author",    VAR_STR,  VAR_RO, &progauthor},
     {"program_name",      VAR_STR,  VAR_RO, &progname},
     {"program_version",   VAR_STR,  VAR_RO, &progversion},
     {"search_string",     VAR_STR,  VAR_RW, &searchstring},
     {"selected_line",     VAR_INT,  VAR_RW, &selline},
+    {"snapshot_cache",    VAR_INT,  VAR_RW, &(cfg.snapshot)},
     {"sort_mode",         VAR_STR,  VAR_RW, &(cfg.sortmode)},
+    {"sort_parallel_min", VAR_INT,  VAR_RW, &(cfg.sort_parallel_min)},
+    {"sort_threads",      VAR_INT,  VAR_RW, &(cfg.sort_threads)},
     {"statusbar_timeout", VAR_INT,  VAR_RW, &(cfg.statusbar_timeout)},
+    {"task_backend",      VAR_STR,  VAR_RW, &(cfg.backend)},
     {"task_count",        VAR_INT,  VAR_RO, &taskcount},
     {"task_format",       VAR_STR,  VAR_RC, &(cfg.formats.task)},
     {"task_version",      VAR_STR,  VAR_RW, &(cfg.version)},
     {"title_format",      VAR_STR,  VAR_RC, &(cfg.formats.title)},
     {"view_format",       VAR_STR,  VAR_RC, &(cfg.formats.view)},
+    {NULL,                VAR_UNDEF, VAR_RO, NULL},
 };
 
 struct funcmap funcmaps[] = {
@@ -157,8 +172,16 @@ void cleanup(void) { /* {{{ */
 
     /* free memory allocated normally */
     check_free(searchstring);
-    free_tasks(head);
+    free_tasks();
     check_free(cfg.sortmode);
+    check_free(cfg.backend);
+    close_task_db();
+    free_data_location();
+    free_symbols();
+    free_sort_plan();
+    free_schedule();
+    free_regex_cache();
+    tasklist_free_line_cache();
     free(cfg.version);
     free(cfg.formats.task);
     free(cfg.formats.title);
@@ -179,6 +202,7 @@ void cleanup(void) { /* {{{ */
     /* close open files */
     fflush(logfp);
     fclose(logfp);
+    logfp = NULL;
 } /* }}} */
 
 void configure(void) { /* {{{ */
@@ -195,6 +219,12 @@ void configure(void) { /* {{{ */
     cfg.sortmode    = strdup("drpu");                   /* determine sort order */
     cfg.follow_task = true;                             /* follow task after it is moved */
     cfg.history_max = 50;
+    cfg.incremental = 1;                                /* only fetch modified tasks on reload */
+    cfg.backend     = strdup("export");                 /* read tasks using task export */
+    cfg.snapshot    = 1;                                /* show cached tasks at startup */
+    cfg.sort_parallel_min = 100000;                     /* sort larger lists on several threads */
+    cfg.sort_threads = 0;                               /* use a thread per cpu */
+    cfg.due_soon    = 7;                                /* days before a due date a task is due soon */
 
     /* set default formats */
     cfg.formats.title = strdup(" $program_name ($selected_line/$task_count) $> $date");
@@ -277,6 +307,11 @@ void configure(void) { /* {{{ */
     compile_formats();
 } /* }}} */
 
+void expire_header(void) { /* {{{ */
+    /* draw the header on the next print_header, for when it was wiped */
+    header_expired = true;
+} /* }}} */
+
 struct funcmap* find_function(const char* name, const enum prog_mode mode) { /* {{{ */
     /* search through the function maps to convert a string to a function pointer
      * name - the string naming the function
@@ -370,6 +405,7 @@ void force_redraw(void) { /* {{{ */
     doupdate();
 
     /* print messages */
+    expire_header();
     print_header();
     tasklist_print_task_list();
     statusbar_message(cfg.statusbar_timeout, "redrawn");
@@ -407,6 +443,7 @@ void handle_resize(void) { /* {{{ */
 
     /* redraw windows */
     tasklist_print_task_list();
+    expire_header();
     print_header();
 
     /* message about resize */
@@ -493,8 +530,8 @@ char max_project_length(void) { /* {{{ */
     struct task*    cur = head;
 
     while (cur) {
-        if (cur->project) {
-            char l = strlen(cur->project);
+        if (cur->project_id > 0) {
+            char l = symbol_width(cur->project_id);
 
             if (l > len) {
                 len = l;
@@ -558,6 +595,7 @@ void ncurses_end(int sig) { /* {{{ */
         tnc_fprintf(stdout, LOG_DEFAULT, "done");
         tnc_fprintf(logfp, LOG_DEBUG, "exiting with code %d", sig);
         print_check_log = false;
+        save_snapshot();
         break;
     }
 
@@ -605,16 +643,35 @@ void ncurses_init(void) { /* {{{ */
 
 void print_header(void) { /* {{{ */
     /* print the window title bar */
-    char* tmp0;
+    static char*            buf = NULL;
+    static size_t           size = 0;
+    static struct format*   drawn_format = NULL;
+    static int              drawn_cols = -1;
+    char*                   tmp0;
+    bool                    changed;
+
+    /* skip drawing if nothing the title shows changed since it was drawn */
+    changed = format_changed(cfg.formats.title_compiled);
+
+    if (!changed && !header_expired && drawn_format == cfg.formats.title_compiled &&
+        drawn_cols == cols) {
+        return;
+    }
+
+    header_expired = false;
+    drawn_format = cfg.formats.title_compiled;
+    drawn_cols = cols;
 
     /* wipe bar and print bg color */
     wmove(header, 0, 0);
     wattrset(header, get_colors(OBJECT_HEADER, NULL, NULL));
 
     /* evaluate title string */
-    tmp0 = (char*)eval_format(cfg.formats.title_compiled, NULL);
-    umvaddstr_align(header, 0, tmp0);
-    free(tmp0);
+    tmp0 = eval_format(cfg.formats.title_compiled, NULL, &buf, &size);
+
+    if (tmp0 != NULL) {
+        umvaddstr_align(header, 0, tmp0);
+    }
 
     wnoutrefresh(header);
 } /* }}} */
@@ -696,58 +753,86 @@ char* str_trim(char* str) { /* {{{ */
     return str;
 } /* }}} */
 
+int umvaddnstr(WINDOW* win, const int y, const int x, const char* str,
+               const int width) { /* {{{ */
+    /* print a utf-8 string in at most a number of columns
+     * win   - the window to print the string in
+     * y     - the y coordinates to print the string at
+     * x     - the x coordinates to print the string at
+     * str   - the string to print
+     * width - the most columns to fill
+     * return is the number of columns filled, or ERR
+     * the conversion buffer is kept between calls and only grows
+     */
+    static wchar_t* wstr = NULL;
+    static size_t   wsize = 0;
+    wchar_t*        tmp;
+    size_t          len = strlen(str) + 1;
+    int             used;
+    int             n;
+
+    if (len > wsize) {
+        tmp = realloc(wstr, len * sizeof(wchar_t));
+
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "critical: umvaddnstr failed to malloc");
+            return ERR;
+        }
+
+        wstr = tmp;
+        wsize = len;
+    }
+
+    n = str_to_wide(str, wstr, width, &used);
+
+    if (n > 0 && mvwaddnwstr(win, y, x, wstr, n) == ERR) {
+        return ERR;
+    }
+
+    return used;
+} /* }}} */
+
 int umvaddstr(WINDOW* win,
               const int y,
               const int x,
               const char* format,
               ...) { /* {{{ */
-    /* convert a string to a wchar string and mvaddwstr
+    /* print a formatted utf-8 string
      * win    - the window to print the string in
      * y      - the y coordinates to print the string at
      * x      - the x coordinates to print the string at
      * format - the format string to print
      * additional args are accepted to use with the format string
      * (similar to printf)
-     * return is the return of mvwaddnwstr
+     * return is the return of umvaddnstr
      */
-    int         len;
-    int         r;
-    wchar_t*    wstr;
-    char*       str;
-    va_list     args;
+    static char*    str = NULL;
+    static int      size = 0;
+    char*           tmp;
+    int             len;
+    va_list         args;
 
-    /* build str */
+    /* build str, growing the kept buffer if it is too short */
     va_start(args, format);
-    const int slen = sizeof(wchar_t) * (cols - x + 1) / sizeof(char);
-    str = calloc(slen, sizeof(char));
-    vsnprintf(str, slen - 1, format, args);
+    len = vsnprintf(str, size, format, args);
     va_end(args);
 
-    /* allocate wchar_t string */
-    len = strlen(str) + 1;
-    wstr = calloc(len, sizeof(wchar_t));
-
-    /* check for valid allocation */
-    if (wstr == NULL) {
-        tnc_fprintf(logfp, LOG_ERROR, "critical: umvaddstr failed to malloc");
-        return -1;
-    }
+    if (len >= size) {
+        tmp = realloc(str, len + 1);
 
-    /* perform conversion and write to screen */
-    mbstowcs(wstr, str, len);
-    len = wcslen(wstr);
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "critical: umvaddstr failed to malloc");
+            return ERR;
+        }
 
-    if (len > cols - x) {
-        len = cols - x;
+        str = tmp;
+        size = len + 1;
+        va_start(args, format);
+        vsnprintf(str, size, format, args);
+        va_end(args);
     }
 
-    r = mvwaddnwstr(win, y, x, wstr, len);
-
-    /* free memory allocated */
-    free(wstr);
-    free(str);
-
-    return r;
+    return umvaddnstr(win, y, x, str, cols - x);
 } /* }}} */
 
 int umvaddstr_align(WINDOW* win, const int y, char* str) { /* {{{ */
@@ -755,13 +840,14 @@ int umvaddstr_align(WINDOW* win, const int y, char* str) { /* {{{ */
      * win - the window to print the string in
      * y   - the y coordinates to print the string at
      * str - the string to parse and print
-     * the return is the return of the first umvaddstr, if it failed
-     * or the return of the second umvaddstr otherwise
+     * the return is the return of the first umvaddnstr, if it failed
+     * or the return of the second umvaddnstr otherwise
      */
     char* right;
     char* pos;
     int   ret;
     int   tmp;
+    int   width;
 
     /* print background line */
     mvwhline(win, y, 0, ' ', cols);
@@ -777,12 +863,13 @@ int umvaddstr_align(WINDOW* win, const int y, char* str) { /* {{{ */
         right = NULL;
     }
 
-    /* print strings */
-    tmp = umvaddstr(win, y, 0, str);
+    /* print strings, the right one ending at the last column */
+    tmp = umvaddnstr(win, y, 0, str, cols);
     ret = tmp;
 
     if (right != NULL) {
-        ret = umvaddstr(win, y, cols - strlen(right), right);
+        width = str_width(right, -1, NULL);
+        ret = width <= cols ? umvaddnstr(win, y, cols - width, right, width) : ERR;
     }
 
     if (tmp > ret) {
@@ -919,8 +1006,11 @@ int main(int argc, char** argv) { /* {{{ */
         umvaddstr(stdscr, 1, 0, "loading tasks...");
         wrefresh(stdscr);
         tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "loading tasks...");
-        head = get_tasks(NULL);
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "%d tasks loaded", taskcount);
+
+        if (!load_snapshot()) {
+            reload_tasks_background();
+        }
+
         mvwhline(stdscr, 0, 0, ' ', COLS);
         mvwhline(stdscr, 1, 0, ' ', COLS);
         wtimeout(stdscr, 1000);
@@ -931,7 +1021,7 @@ int main(int argc, char** argv) { /* {{{ */
     /* debug mode */
     else {
         configure();
-        head = get_tasks(NULL);
+        reload_tasks();
         test(debugopts);
         free(debugopts);
     }
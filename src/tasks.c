@@ -7,65 +7,212 @@
 #define _GNU_SOURCE
 #include <curses.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <time.h>
+#include "arena.h"
 #include "common.h"
 #include "config.h"
+#include "json.h"
+#include "loader.h"
 #include "log.h"
+#include "schedule.h"
+#include "snapshot.h"
 #include "sort.h"
+#include "symbols.h"
 #include "tasklist.h"
+#include "taskdata.h"
+#include "taskdb.h"
 #include "tasks.h"
 
 /* local function declarations */
-static time_t strtotime(const char* timestr);
-static void set_char(char* field, char** line);
-static void set_date(time_t* field, char** line);
-static void set_int(unsigned short* field, char** line);
-static void set_string(char** field, char** line);
-
-char free_task(struct task* tsk) { /* {{{ */
-    /* free the memory allocated to a task
-     * tsk - the task to free
-     * return is always 0
+static char* export_command(const char* args);
+static struct task* export_tasks(const char* cmdstr, struct arena* arena, time_t* modified);
+static void finish_loading_tasks(void);
+static bool reload_tasks_incremental(void);
+static bool reposition_task(struct task* this, struct task* new);
+static time_t strtotime(const char* timestr, const size_t len);
+static bool set_char(char* field, struct json_parser* json);
+static bool set_date(time_t* field, struct json_parser* json);
+static bool set_int(unsigned short* field, struct json_parser* json);
+static bool set_string(char** field, struct json_parser* json, struct arena* arena);
+static bool set_tags(char** field, struct json_parser* json, struct arena* arena);
+static int uuid_index_find(const uint64_t hi, const uint64_t lo);
+static void uuid_index_remove(unsigned int slot);
+static bool uuid_key(const char* uuid, uint64_t* hi, uint64_t* lo);
+
+/* convert two ascii digits to an integer */
+#define DIGITS2(x)                      (((x)[0] - '0') * 10 + ((x)[1] - '0'))
+
+/* initial arena chunk sizes */
+#define TASK_ARENA_CHUNK                (64 << 10)
+#define SIDE_ARENA_CHUNK                (4 << 10)
+
+/* task storage: all tasks from the last full load and their strings live in
+ * task_arena, tasks reloaded one at a time are allocated from side_arena */
+static struct arena* task_arena = NULL;
+static struct arena* side_arena = NULL;
+
+/* the filter and latest modification time of the loaded tasks, which
+ * decide whether a reload can fetch only the tasks changed since */
+static char* loaded_filter = NULL;
+static time_t last_modified = 0;
+
+/* the data file stamp taken before the loaded tasks were read, which
+ * decides whether a snapshot of them is still current, and the stamp of
+ * the snapshot on disk */
+static uint64_t loaded_stamp = 0;
+static uint64_t snapshot_stamp = 0;
+
+/* background load: the export being read while the tasklist stays responsive,
+ * a progressive load shows its tasks as they arrive since nothing else is shown,
+ * the filter is the one the export was started with */
+static struct task_loader task_load;
+static uint64_t task_load_stamp = 0;
+static char* task_load_filter = NULL;
+static bool loading = false;
+static bool loading_progressive = false;
+
+/* the version given to the last task allocated */
+static unsigned long task_version = 0;
+
+/* positional index: task_index[n] is the task displayed on line n */
+static struct task** task_index = NULL;
+static int task_index_size = 0;
+
+/**
+ * uuid index slot - an open addressed hash table entry
+ * hi  - the upper 64 bits of the binary uuid
+ * lo  - the lower 64 bits of the binary uuid
+ * pos - the position of the task in task_index, or -1 for an empty slot
+ */
+struct uuid_slot {
+    uint64_t hi;
+    uint64_t lo;
+    int pos;
+};
+
+/* uuid index: maps binary uuids to positions, sized to a power of two */
+static struct uuid_slot* uuid_index = NULL;
+static unsigned int uuid_index_mask = 0;
+
+void expire_tasks(void) { /* {{{ */
+    /* force the next reload to export every task again
+     * used after commands which can change tasks without bumping their
+     * modification time, such as undo and sync
+     */
+    last_modified = 0;
+} /* }}} */
+
+char* export_command(const char* args) { /* {{{ */
+    /* build the command exporting the tasks matching the active filter
+     * args - further arguments to append to the filter, or NULL
+     * return is the allocated command string
      */
-    char ret = 0;
+    char* cmdstr;
 
-    free(tsk->uuid);
+    asprintf(&cmdstr, "%s %s %s", cfg.version[0] < '2' ? "task export.json" : "task export",
+             active_filter != NULL ? active_filter : "", args != NULL ? args : "");
 
-    if (tsk->tags != NULL) {
-        free(tsk->tags);
-    }
+    return cmdstr;
+} /* }}} */
 
-    if (tsk->project != NULL) {
-        free(tsk->project);
-    }
+struct task* export_tasks(const char* cmdstr, struct arena* arena,
+                          time_t* modified) { /* {{{ */
+    /* run an export command and parse its output into a list of tasks
+     * cmdstr   - the command to run
+     * arena    - the arena the tasks will be allocated from
+     * modified - where the latest modification time seen will be stored
+     * return is the first task in the unsorted list
+     */
+    struct task_loader l;
 
-    if (tsk->description != NULL) {
-        free(tsk->description);
+    if (!loader_open(&l, cmdstr, arena, false)) {
+        return NULL;
     }
 
-    free(tsk);
+    while (loader_read(&l));
 
-    return ret;
+    if (l.modified > *modified) {
+        *modified = l.modified;
+    }
+
+    return loader_close(&l);
 } /* }}} */
 
-void free_tasks(struct task* head) { /* {{{ */
-    /* free the task stack
-     * head - the first task on the stack to free
-     */
-    struct task* cur;
-    struct task* next;
+void finish_loading_tasks(void) { /* {{{ */
+    /* install the tasks from a finished background load */
+    struct task* new_head;
+    struct task* tail;
 
-    cur = head;
+    new_head = loader_close(&task_load);
+    loading = false;
 
-    while (cur != NULL) {
-        next = cur->next;
-        free_task(cur);
-        cur = next;
+    /* a progressive load already shows its tasks, so only the rest are added
+     * and tasks reloaded since in the side arena are kept */
+    if (loading_progressive) {
+        tail = get_task_by_position(taskcount - 1);
+
+        if (tail == NULL) {
+            head = new_head;
+        } else if (new_head != NULL) {
+            tail->next = new_head;
+            new_head->prev = tail;
+        }
+
+        task_arena = task_load.arena;
+    } else {
+        free_tasks();
+        task_arena = task_load.arena;
+        head = new_head;
+    }
+
+    /* the filter may have changed while the export ran */
+    last_modified = task_load.modified;
+    loaded_stamp = task_load_stamp;
+    free(loaded_filter);
+    loaded_filter = task_load_filter;
+    task_load_filter = NULL;
+    tnc_fprintf(logfp, LOG_DEBUG, "task arena holds %lu bytes",
+                (unsigned long)task_arena->allocated);
+
+    /* sort tasks */
+    if (head != NULL) {
+        head = sort_wrapper(head);
     }
+
+    task_count();
+    tnc_fprintf(logfp, LOG_DEBUG, "%d tasks loaded", taskcount);
+} /* }}} */
+
+void free_tasks(void) { /* {{{ */
+    /* free every loaded task at once by releasing the task arenas */
+    if (loading) {
+        loader_close(&task_load);
+        arena_free(task_load.arena);
+        free(task_load_filter);
+        task_load_filter = NULL;
+        loading = false;
+    }
+
+    expire_schedule();
+    arena_free(task_arena);
+    arena_free(side_arena);
+    task_arena = NULL;
+    side_arena = NULL;
+    free(task_index);
+    free(uuid_index);
+    check_free(loaded_filter);
+    loaded_filter = NULL;
+    last_modified = 0;
+    loaded_stamp = 0;
+    task_index = NULL;
+    task_index_size = 0;
+    uuid_index = NULL;
+    uuid_index_mask = 0;
+    taskcount = 0;
 } /* }}} */
 
 struct task* get_task_by_position(int n) { /* {{{ */
@@ -75,17 +222,17 @@ struct task* get_task_by_position(int n) { /* {{{ */
      * or null if n > # of tasks on the stack
      */
     struct task* cur;
-    short        i = -1;
-
-    cur = head;
 
-    while (cur != NULL) {
-        i++;
+    if (n < 0 || n >= taskcount) {
+        return NULL;
+    }
 
-        if (i == n) {
-            break;
-        }
+    if (task_index != NULL) {
+        return task_index[n];
+    }
 
+    /* no index could be allocated, walk the list */
+    for (cur = head; cur != NULL && n > 0; n--) {
         cur = cur->next;
     }
 
@@ -98,21 +245,22 @@ int get_task_position_by_uuid(const char* uuid) { /* {{{ */
      * return is the line number which matches the uuid
      * or -1 if no task on the stack matches this uuid
      */
-    struct task* cur;
-    int          pos = 0;
+    uint64_t    hi;
+    uint64_t    lo;
+    int         pos;
 
-    cur = head;
-
-    while (cur != NULL && !str_eq(cur->uuid, uuid)) {
-        cur = cur->next;
-        pos++;
+    if (uuid_index != NULL && uuid_key(uuid, &hi, &lo)) {
+        return uuid_index[uuid_index_find(hi, lo)].pos;
     }
 
-    if (cur != NULL && str_eq(cur->uuid, uuid)) {
-        return pos;
-    } else {
-        return -1;
+    /* fall back to comparing strings for unindexed or malformed uuids */
+    for (pos = 0; pos < taskcount; pos++) {
+        if (str_eq(get_task_by_position(pos)->uuid, uuid)) {
+            return pos;
+        }
     }
+
+    return -1;
 } /* }}} */
 
 struct task* get_tasks(char* uuid) { /* {{{ */
@@ -121,118 +269,69 @@ struct task* get_tasks(char* uuid) { /* {{{ */
      *        pass NULL to get a full task list
      * return is the task data for a single task, if a uuid was passed
      * or all tasks, if uuid == NULL
+     * a full load releases all previously loaded tasks
      */
-    FILE*           cmd;
-    char*           line;
-    char*           tmp;
-    char*           cmdstr;
-    int             linelen = TOTALLENGTH;
-    unsigned short  counter = 0;
-    struct task*    last;
-    struct task*    new_head;
-
-    /* generate & run command */
-    cmdstr = calloc(128, sizeof(char));
-
-    if (cfg.version[0] < '2') {
-        strcat(cmdstr, "task export.json");
+    char*               cmdstr;
+    char*               filter = NULL;
+    time_t              modified = 0;
+    uint64_t            stamp = 0;
+    bool                direct = false;
+    struct task*        new_head;
+    struct arena*       arena;
+
+    /* generate command */
+    cmdstr = export_command(uuid);
+
+    /* pick the arena the new tasks will live in */
+    if (uuid == NULL) {
+        arena = arena_create(TASK_ARENA_CHUNK);
     } else {
-        strcat(cmdstr, "task export");
-    }
-
-    if (active_filter != NULL) {
-        strcat(cmdstr, " ");
-        strcat(cmdstr, active_filter);
-    }
+        if (side_arena == NULL) {
+            side_arena = arena_create(SIDE_ARENA_CHUNK);
+        }
 
-    if (uuid != NULL) {
-        strcat(cmdstr, " ");
-        strcat(cmdstr, uuid);
+        arena = side_arena;
     }
 
-    tnc_fprintf(logfp, LOG_DEBUG, "reloading tasks (%s)", cmdstr);
-    cmd = popen(cmdstr, "r");
-
-    if (cmd == NULL) {
-        tnc_fprintf(logfp, LOG_ERROR, "could not execute command: (%s)", cmdstr);
-        tnc_fprintf(stdout, LOG_ERROR, "could not execute command: (%s)", cmdstr);
+    if (arena == NULL) {
+        tnc_fprintf(logfp, LOG_ERROR, "could not allocate task arena");
         free(cmdstr);
         return NULL;
     }
 
-    free(cmdstr);
-
-    /* parse output */
-    last        = NULL;
-    new_head    = NULL;
-    line        = calloc(linelen, sizeof(char));
-
-    while (fgets(line, linelen - 1, cmd) != NULL || !feof(cmd)) {
-        struct task* this;
-
-        /* check for longer lines */
-        while (strchr(line, '\n') == NULL) {
-            linelen += TOTALLENGTH;
-            line = realloc(line, linelen * sizeof(char));
-            tmp = calloc(TOTALLENGTH, sizeof(char));
-
-            if (fgets(tmp, TOTALLENGTH - 1, cmd) == NULL) {
-                break;
-            }
-
-            strcat(line, tmp);
-            free(tmp);
-        }
-
-        /* remove escapes */
-        remove_char(line, '\\');
-
-        /* log line */
-        tmp = strchr(line, '\n');
-        *tmp = 0;
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, line);
-
-        /* parse line */
-        this = parse_task(line);
-
-        if (this == NULL) {
-            return NULL;
-        } else if (this == (struct task*) - 1) {
-            continue;
-        } else if (this->uuid == NULL ||
-                   this->description == NULL) {
-            return NULL;
-        }
-
-        /* set pointers */
-        this->prev = last;
+    /* note the state of the data files and the filter before a full load */
+    if (uuid == NULL) {
+        stamp = data_stamp();
+        filter = active_filter != NULL ? strdup(active_filter) : NULL;
+    }
 
-        if (counter == 0) {
-            new_head = this;
-        }
+    /* read the data file or database directly if possible, falling back to export */
+    if (str_eq(cfg.backend, "data")) {
+        direct = read_data_file(active_filter, uuid, arena, &new_head, &modified);
+    } else if (str_eq(cfg.backend, "sqlite")) {
+        direct = read_task_db(active_filter, uuid, arena, &new_head, &modified);
+    }
 
-        if (counter > 0) {
-            last->next = this;
-        }
+    if (!direct) {
+        new_head = export_tasks(cmdstr, arena, &modified);
+    }
 
-        last = this;
-        counter++;
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "uuid:        %s", this->uuid);
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "description: %s", this->description);
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "project:     %s", this->project);
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "tags:        %s", this->tags);
+    free(cmdstr);
 
-        /* prepare a new line */
-        free(line);
-        line = calloc(linelen, sizeof(char));
+    /* replace the previous generation of tasks */
+    if (uuid == NULL) {
+        free_tasks();
+        task_arena = arena;
+        last_modified = modified;
+        loaded_stamp = stamp;
+        loaded_filter = filter;
+        tnc_fprintf(logfp, LOG_DEBUG, "task arena holds %lu bytes",
+                    (unsigned long)arena->allocated);
     }
 
-    free(line);
-    pclose(cmd);
-
     /* sort tasks */
     if (new_head != NULL) {
-        sort_wrapper(new_head);
+        new_head = sort_wrapper(new_head);
     }
 
     return new_head;
@@ -270,121 +369,261 @@ unsigned short get_task_id(char* uuid) { /* {{{ */
     return id;
 } /* }}} */
 
-struct task* malloc_task(void) { /* {{{ */
+bool load_snapshot(void) { /* {{{ */
+    /* show the tasks saved by the last run for the active filter
+     * return is whether they are still current, false means a reload is needed
+     */
+    struct arena*   arena;
+    struct task*    new_head;
+    time_t          modified;
+    uint64_t        stamp;
+
+    if (!cfg.snapshot) {
+        return false;
+    }
+
+    arena = arena_create(TASK_ARENA_CHUNK);
+
+    if (arena == NULL || !snapshot_read(active_filter, arena, &new_head, &modified, &stamp)) {
+        arena_free(arena);
+        return false;
+    }
+
+    free_tasks();
+    task_arena = arena;
+    head = new_head;
+    loaded_filter = active_filter != NULL ? strdup(active_filter) : NULL;
+
+    if (head != NULL) {
+        head = sort_wrapper(head);
+    }
+
+    task_count();
+
+    /* stale tasks are shown until a full reload replaces them */
+    if (stamp == 0 || stamp != data_stamp()) {
+        tnc_fprintf(logfp, LOG_DEBUG, "snapshot is out of date");
+        return false;
+    }
+
+    last_modified = modified;
+    loaded_stamp = stamp;
+    snapshot_stamp = stamp;
+
+    return true;
+} /* }}} */
+
+void intern_task(struct task* tsk, struct arena* arena) { /* {{{ */
+    /* intern the project and each tag of a parsed task
+     * the project string is replaced by the shared symbol
+     * tsk   - the task to intern strings of
+     * arena - the arena the tag id array will be allocated from
+     */
+    const char* pos;
+    const char* end;
+    int         ntags = 1;
+
+    tsk->project_id = tsk->project != NULL ? intern(tsk->project, strlen(tsk->project)) : 0;
+
+    if (tsk->project_id > 0) {
+        tsk->project = (char*)symbol_name(tsk->project_id);
+    }
+
+    if (tsk->tags == NULL || *(tsk->tags) == 0) {
+        return;
+    }
+
+    for (pos = tsk->tags; (pos = strchr(pos, ',')) != NULL; pos++) {
+        ntags++;
+    }
+
+    tsk->tag_ids = arena_alloc(arena, ntags * sizeof(int));
+
+    if (tsk->tag_ids == NULL) {
+        return;
+    }
+
+    for (pos = tsk->tags; *pos != 0; pos = *end != 0 ? end + 1 : end) {
+        end = pos + strcspn(pos, ",");
+
+        if (end > pos) {
+            tsk->tag_ids[tsk->ntags++] = intern(pos, end - pos);
+        }
+    }
+} /* }}} */
+
+struct task* malloc_task(struct arena* arena) { /* {{{ */
     /* allocate memory for a new task
      * and initialize values where necessary
+     * arena - the arena the task will be allocated from
      * return is the newly allocated task
      */
-    struct task* tsk = calloc(1, sizeof(struct task));
+    struct task* tsk = arena_alloc(arena, sizeof(struct task));
 
     if (tsk == NULL) {
         return NULL;
     }
 
-    tsk->index          = 0;
-    tsk->uuid           = NULL;
-    tsk->tags           = NULL;
-    tsk->start          = 0;
-    tsk->end            = 0;
-    tsk->entry          = 0;
-    tsk->due            = 0;
-    tsk->project        = NULL;
-    tsk->priority       = 0;
-    tsk->description    = NULL;
-    tsk->next           = NULL;
-    tsk->prev           = NULL;
+    /* the sorted orders and schedule of the previous tasks no longer apply */
+    expire_sort_orders();
+    expire_schedule();
+
+    tsk->version        = ++task_version;
     tsk->pair           = -1;
     tsk->selpair        = -1;
+    tsk->colorgen       = 0;
 
     return tsk;
 } /* }}} */
 
-struct task* parse_task(char* line) { /* {{{ */
+struct task* parse_task(struct json_parser* json, struct arena* arena) { /* {{{ */
     /* parse a line of output from `task export ...`
-     * line - the line to parse
+     * json  - a parser pointed at the line to parse
+     * arena - the arena the task and its strings will be allocated from
      * return is the task structure defined in the line,
-     * or -1 if this line is not a task or parsing failed
+     * -1 if this line is not a task, or NULL if allocation failed
      */
-    struct task* tsk = malloc_task();
+    struct task*    tsk;
+    const char*     key;
+    size_t          keylen;
+    bool            handled;
+    int             ret;
 
     /* detect lines that are not json */
-    if (*line != '{') {
+    if (!json_object_begin(json)) {
         return (struct task*) - 1;
     }
 
-    line++;
+    tsk = malloc_task(arena);
 
-    /* parse json */
-    while (*line != 0) {
-        /* local vars */
-        char* field = NULL;
-        int ret;
+    if (tsk == NULL) {
+        return NULL;
+    }
 
-        /* skip field delimiters */
-        if (*line == ',') {
-            line++;
-            continue;
-        }
+    /* parse json, dispatching on the length of the field name first */
+    while ((ret = json_next_member(json, &key, &keylen)) == 1) {
+        handled = false;
+
+        switch (keylen) {
+        case 2:
+            if (memcmp(key, "id", 2) == 0) {
+                handled = set_int(&(tsk->index), json);
+            }
 
-        /* terminate at end of line */
-        if (*line == '}') {
             break;
-        }
 
-        /* get field */
-        ret = sscanf(line, "\"%m[^\"]\":", &field);
+        case 3:
+            if (memcmp(key, "due", 3) == 0) {
+                handled = set_date(&(tsk->due), json);
+            } else if (memcmp(key, "end", 3) == 0) {
+                handled = set_date(&(tsk->end), json);
+            }
 
-        if (ret != 1) {
-            tnc_fprintf(logfp, LOG_ERROR, "error parsing task @ %s", line);
-            return (struct task*) - 1;
-        }
+            break;
 
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "field: %s", field);
-        line += strlen(field) + 3;
+        case 4:
+            if (memcmp(key, "uuid", 4) == 0) {
+                handled = set_string(&(tsk->uuid), json, arena);
+            } else if (memcmp(key, "tags", 4) == 0) {
+                handled = set_tags(&(tsk->tags), json, arena);
+            }
 
-        /* determine how to handle content */
-        if (str_eq(field, "id")) {
-            set_int(&(tsk->index), &line);
-        } else if (str_eq(field, "description")) {
-            set_string(&(tsk->description), &line);
-        } else if (str_eq(field, "project")) {
-            set_string(&(tsk->project), &line);
-        } else if (str_eq(field, "tags")) {
-            char* pos = line;
+            break;
 
-            while (*pos != ']') {
-                pos++;
+        case 5:
+            if (memcmp(key, "entry", 5) == 0) {
+                handled = set_date(&(tsk->entry), json);
+            } else if (memcmp(key, "start", 5) == 0) {
+                handled = set_date(&(tsk->start), json);
             }
 
-            tsk->tags = strndup(line + 1, pos - line - 1);
-            line = pos + 1;
-            tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "string: %s", tsk->tags);
-        } else if (str_eq(field, "uuid")) {
-            set_string(&(tsk->uuid), &line);
-        } else if (str_eq(field, "entry")) {
-            set_date(&(tsk->entry), &line);
-        } else if (str_eq(field, "due")) {
-            set_date(&(tsk->due), &line);
-        } else if (str_eq(field, "priority")) {
-            set_char(&(tsk->priority), &line);
-        } else if (str_eq(field, "annotations")) {
-            while (*line != ']') {
-                line++;
+            break;
+
+        case 7:
+            if (memcmp(key, "project", 7) == 0) {
+                handled = set_string(&(tsk->project), json, arena);
             }
 
-            line++;
-        } else { /* unknown field */
-            while (*line != ',' && *line != '}') {
-                line++;
+            break;
+
+        case 8:
+            if (memcmp(key, "priority", 8) == 0) {
+                handled = set_char(&(tsk->priority), json);
+            } else if (memcmp(key, "modified", 8) == 0) {
+                handled = set_date(&(tsk->modified), json);
             }
+
+            break;
+
+        case 11:
+            if (memcmp(key, "description", 11) == 0) {
+                handled = set_string(&(tsk->description), json, arena);
+            }
+
+            break;
+
+        default:
+            break;
         }
 
-        free(field);
+        /* skip unknown fields and values of an unexpected type */
+        if (!handled && !json_skip(json)) {
+            ret = -1;
+            break;
+        }
     }
 
+    if (ret < 0) {
+        tnc_fprintf(logfp, LOG_ERROR, "error parsing task @ %.*s",
+                    (int)(json->end - json->pos), json->pos);
+    }
+
+    intern_task(tsk, arena);
+
     return tsk;
 } /* }}} */
 
+bool read_tasks_background(void) { /* {{{ */
+    /* read the output a background load has available
+     * return is whether the task list changed
+     */
+    struct task*    new_tasks;
+    struct task*    tail;
+    bool            more;
+
+    if (!loading) {
+        return false;
+    }
+
+    more = loader_read(&task_load);
+
+    /* show tasks as they arrive if nothing else is displayed */
+    if (loading_progressive && task_load.head != NULL) {
+        new_tasks = loader_take(&task_load);
+        tail = get_task_by_position(taskcount - 1);
+
+        if (tail == NULL) {
+            head = new_tasks;
+        } else {
+            tail->next = new_tasks;
+            new_tasks->prev = tail;
+        }
+
+        task_count();
+
+        if (more) {
+            return true;
+        }
+    }
+
+    if (!more) {
+        finish_loading_tasks();
+        return true;
+    }
+
+    return false;
+} /* }}} */
+
 void reload_task(struct task* this) { /* {{{ */
     /* reload an individual task's data
      * this - the task whose data needs reloading
@@ -411,8 +650,8 @@ void reload_task(struct task* this) { /* {{{ */
             this->next->prev = this->prev;
         }
 
-        taskcount--;
-    } else {
+        unindex_task(this);
+    } else if (!reposition_task(this, new)) {
         /* transfer pointers */
         new->prev = this->prev;
         new->next = this->next;
@@ -437,13 +676,13 @@ void reload_task(struct task* this) { /* {{{ */
             tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "reload_task(%s): setting task as head",
                         this->uuid);
         }
-    }
 
-    /* free old task */
-    free_task(this);
+        /* re-sort task list */
+        head = sort_wrapper(head);
+        task_count();
+    }
 
-    /* re-sort task list */
-    sort_wrapper(head);
+    /* the old task is released along with its arena */
 } /* }}} */
 
 void reload_tasks() { /* {{{ */
@@ -452,9 +691,11 @@ void reload_tasks() { /* {{{ */
 
     tnc_fprintf(logfp, LOG_DEBUG, "reloading tasks");
 
-    free_tasks(head);
+    if (!reload_tasks_incremental()) {
+        head = get_tasks(NULL);
+    }
 
-    head = get_tasks(NULL);
+    task_count();
 
     /* debug */
     cur = head;
@@ -468,124 +709,382 @@ void reload_tasks() { /* {{{ */
     }
 } /* }}} */
 
-void remove_char(char* str, char remove) { /* {{{ */
-    /* iterate through a string and remove escapes inline
-     * str    - the string to remove escapes from
-     * remove - the escape to remove
+bool reload_tasks_background(void) { /* {{{ */
+    /* start reloading tasks without waiting for the export to finish
+     * return is whether a background load is running,
+     * false means the reload has already completed
      */
-    const int   len = strlen(str);
-    int         i;
-    int         offset = 0;
+    char*           cmdstr;
+    struct arena*   arena;
 
-    for (i = 0; i < len; i++) {
-        if (str[i + offset] == '\0') {
-            break;
+    if (loading) {
+        return true;
+    }
+
+    tnc_fprintf(logfp, LOG_DEBUG, "reloading tasks in background");
+
+    /* reading the data file or database is fast enough to do in the foreground */
+    if (str_eq(cfg.backend, "data") || str_eq(cfg.backend, "sqlite")) {
+        reload_tasks();
+        return false;
+    }
+
+    if (reload_tasks_incremental()) {
+        task_count();
+        return false;
+    }
+
+    arena = arena_create(TASK_ARENA_CHUNK);
+    cmdstr = export_command(NULL);
+    task_load_stamp = data_stamp();
+    task_load_filter = active_filter != NULL ? strdup(active_filter) : NULL;
+
+    if (arena == NULL || !loader_open(&task_load, cmdstr, arena, true)) {
+        arena_free(arena);
+        free(cmdstr);
+        free(task_load_filter);
+        task_load_filter = NULL;
+        reload_tasks();
+        return false;
+    }
+
+    free(cmdstr);
+    loading = true;
+    loading_progressive = head == NULL && task_arena == NULL;
+
+    return true;
+} /* }}} */
+
+bool reload_tasks_incremental(void) { /* {{{ */
+    /* merge the tasks modified since the last load into the task list
+     * return is whether the list was updated, false means a full reload is needed
+     */
+    FILE*           cmd;
+    char*           cmdstr;
+    char*           line = NULL;
+    size_t          linecap = 0;
+    char            since[TIMELENGTH];
+    char            uuid[UUIDLENGTH + 1];
+    int*            ids;
+    unsigned short  id;
+    time_t          modified = last_modified;
+    uint64_t        stamp;
+    struct tm*      tmr;
+    struct task*    cur;
+    struct task*    next;
+    struct task*    old;
+    int             pos;
+    int             ret;
+    int             listed = 0;
+    int             changed = 0;
+    int             removed = 0;
+    int             renumbered = 0;
+
+    /* a changed filter, old task version or unknown modification times
+     * all require a full export, and direct reads always read everything */
+    if (!cfg.incremental || !str_eq(cfg.backend, "export") || head == NULL || last_modified == 0 ||
+        cfg.version[0] < '2' || loaded_filter == NULL || active_filter == NULL ||
+        !str_eq(loaded_filter, active_filter)) {
+        return false;
+    }
+
+    /* replaced tasks are not freed until the next full load */
+    if (side_arena != NULL && task_arena != NULL &&
+        side_arena->allocated > task_arena->allocated) {
+        tnc_fprintf(logfp, LOG_DEBUG, "incremental reload: compacting task storage");
+        return false;
+    }
+
+    /* list the uuids and ids of the tasks still matching the filter to find
+     * removed tasks, as ids change after tasks are completed or deleted
+     * without changing the modification time of the others */
+    ids = malloc(taskcount * sizeof(int));
+
+    if (ids == NULL) {
+        return false;
+    }
+
+    for (pos = 0; pos < taskcount; pos++) {
+        ids[pos] = -1;
+    }
+
+    stamp = data_stamp();
+    asprintf(&cmdstr, "task rc.report.all.columns:uuid,id rc.report.all.labels:UUID,id "
+             "rc.verbose:nothing rc._forcecolor=no '(' %s ')' all", active_filter);
+    cmd = popen(cmdstr, "r");
+    free(cmdstr);
+
+    if (cmd == NULL) {
+        free(ids);
+        return false;
+    }
+
+    while (getline(&line, &linecap, cmd) > 0) {
+        id = 0;
+        ret = sscanf(line, "%36s %hu", uuid, &id);
+
+        if (ret < 1 || (pos = get_task_position_by_uuid(uuid)) < 0) {
+            continue;
         }
 
-        str[i] = str[i + offset];
+        ids[pos] = id;
+        listed++;
+    }
+
+    free(line);
 
-        while (str[i] == remove || str[i] == '\0') {
-            offset++;
+    /* a failed listing would remove every task */
+    if (pclose(cmd) != 0 || listed == 0) {
+        tnc_fprintf(logfp, LOG_DEBUG, "incremental reload: could not list tasks");
+        free(ids);
+        return false;
+    }
 
-            if (i + offset >= len) {
-                break;
-            }
+    /* renumber the tasks which were not modified */
+    for (pos = 0; pos < taskcount; pos++) {
+        old = get_task_by_position(pos);
 
-            str[i] = str[i + offset];
+        if (ids[pos] >= 0 && old->index != ids[pos]) {
+            old->index = ids[pos];
+            old->version = ++task_version;
+            renumbered++;
         }
+    }
 
-        if (str[i + offset] == '\0') {
-            break;
+    if (renumbered > 0) {
+        expire_sort_orders();
+    }
+
+    /* fetch tasks modified since the last load, allowing for changes made
+     * later during the same second */
+    if (side_arena == NULL) {
+        side_arena = arena_create(SIDE_ARENA_CHUNK);
+    }
+
+    last_modified--;
+    tmr = gmtime(&last_modified);
+    strftime(since, TIMELENGTH, "%Y%m%dT%H%M%SZ", tmr);
+    asprintf(&cmdstr, "task export '(' %s ')' modified.after:%s", active_filter, since);
+    cur = export_tasks(cmdstr, side_arena, &modified);
+    free(cmdstr);
+    last_modified = modified;
+    loaded_stamp = stamp;
+
+    /* unlink tasks that no longer match */
+    for (pos = 0; pos < taskcount; pos++) {
+        if (ids[pos] >= 0) {
+            continue;
         }
+
+        old = get_task_by_position(pos);
+
+        if (old->prev != NULL) {
+            old->prev->next = old->next;
+        } else {
+            head = old->next;
+        }
+
+        if (old->next != NULL) {
+            old->next->prev = old->prev;
+        }
+
+        removed++;
     }
 
-} /* }}} */
+    /* replace modified tasks in place and add new tasks to the top */
+    for (; cur != NULL; cur = next) {
+        next = cur->next;
+        pos = get_task_position_by_uuid(cur->uuid);
 
-void set_char(char* field, char** line) { /* {{{ */
-    /* set a character field from the next contents of line
-     * field - the field set the character in
-     * line  - the line to parse the character from
-     */
-    int ret = sscanf(*line, "\"%c\"", field);
+        if (pos >= 0 && ids[pos] >= 0) {
+            old = get_task_by_position(pos);
+            cur->prev = old->prev;
+            cur->next = old->next;
 
-    if (ret != 1) {
-        tnc_fprintf(logfp, LOG_ERROR, "error parsing char @ %s", *line);
-    } else {
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "char: %c", *field);
+            if (old->prev != NULL) {
+                old->prev->next = cur;
+            } else {
+                head = cur;
+            }
+
+            if (old->next != NULL) {
+                old->next->prev = cur;
+            }
+        } else {
+            cur->prev = NULL;
+            cur->next = head;
+
+            if (head != NULL) {
+                head->prev = cur;
+            }
+
+            head = cur;
+        }
+
+        changed++;
     }
 
-    while (**line != ',' &&** line != '}') {
-        (*line)++;
+    free(ids);
+
+    tnc_fprintf(logfp, LOG_DEBUG, "incremental reload: %d tasks changed, %d removed, %d renumbered",
+                changed, removed, renumbered);
+
+    if (head != NULL) {
+        head = sort_wrapper(head);
     }
+
+    return true;
 } /* }}} */
 
-void set_date(time_t* field, char** line) { /* {{{ */
-    /* set a time field from the next contents of line
-     * field - the field set the time in
-     * line  - the line to parse the time from
+bool reposition_task(struct task* this, struct task* new) { /* {{{ */
+    /* replace a task with its reloaded copy, moving the copy to where it sorts
+     * this - the task being replaced
+     * new  - the reloaded task
+     * return is whether the task was found in the positional index, only
+     * the tasks between its old and new positions are touched
      */
-    char*   tmp;
-    int     ret = sscanf(*line, "\"%m[^\"]\"", &tmp);
+    uint64_t        hi;
+    uint64_t        lo;
+    int             old;
+    int             pos;
+    int             first;
+    int             last;
+    int             slot;
+    int             i;
+
+    if (task_index == NULL) {
+        return false;
+    }
+
+    /* find the task, checking the uuid lookup in case of duplicate uuids */
+    old = get_task_position_by_uuid(this->uuid);
+
+    if (old < 0 || task_index[old] != this) {
+        for (old = 0; old < taskcount && task_index[old] != this; old++);
 
-    if (ret != 1) {
-        tnc_fprintf(logfp, LOG_ERROR, "error parsing time @ %s", *line);
+        if (old == taskcount) {
+            return false;
+        }
+    }
+
+    /* shift the tasks between the old and new positions over by a line */
+    pos = sort_position(task_index, taskcount, new, old);
+
+    if (pos < old) {
+        memmove(task_index + pos + 1, task_index + pos, (old - pos) * sizeof(struct task*));
     } else {
-        *field = strtotime(tmp);
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "time: %d", (int)*field);
-        free(tmp);
+        memmove(task_index + old, task_index + old + 1, (pos - old) * sizeof(struct task*));
     }
 
-    while (**line != ',' &&** line != '}') {
-        (*line)++;
+    task_index[pos] = new;
+
+    /* unlink the old task and link the new one between its neighbours */
+    if (this->prev != NULL) {
+        this->prev->next = this->next;
+    } else {
+        head = this->next;
     }
-} /* }}} */
 
-void set_int(unsigned short* field, char** line) { /* {{{ */
-    /* set an integer field from the next contents of line
-     * field - the field set the integer in
-     * line  - the line to parse the integer from
-     */
-    int ret = sscanf(*line, "%hd", field);
+    if (this->next != NULL) {
+        this->next->prev = this->prev;
+    }
 
-    if (ret != 1) {
-        tnc_fprintf(logfp, LOG_ERROR, "error parsing integer @ %s", *line);
+    new->prev = pos > 0 ? task_index[pos - 1] : NULL;
+    new->next = pos < taskcount - 1 ? task_index[pos + 1] : NULL;
+
+    if (new->prev != NULL) {
+        new->prev->next = new;
     } else {
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "int: %d", *field);
+        head = new;
+    }
+
+    if (new->next != NULL) {
+        new->next->prev = new;
     }
 
-    while (**line != ',' &&** line != '}') {
-        (*line)++;
+    /* update the lines of the moved tasks */
+    first = MIN(old, pos);
+    last = old > pos ? old : pos;
+
+    for (i = first; uuid_index != NULL && i <= last; i++) {
+        if (uuid_key(task_index[i]->uuid, &hi, &lo)) {
+            slot = uuid_index_find(hi, lo);
+
+            if (uuid_index[slot].pos >= first && uuid_index[slot].pos <= last) {
+                uuid_index[slot].pos = i;
+            }
+        }
     }
+
+    tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "reload_task(%s): moved from line %d to %d",
+                new->uuid, old, pos);
+
+    return true;
 } /* }}} */
 
-void set_string(char** field, char** line) { /* {{{ */
-    /* set an string field from the next contents of line
-     * field - the field set the string in
-     * line  - the line to parse the string from
+void save_snapshot(void) { /* {{{ */
+    /* save the loaded tasks for the next run to show at startup */
+    if (!cfg.snapshot || loading || loaded_stamp == 0 || loaded_stamp == snapshot_stamp ||
+        loaded_filter == NULL || active_filter == NULL || !str_eq(loaded_filter, active_filter)) {
+        return;
+    }
+
+    if (snapshot_write(loaded_filter, head, last_modified, loaded_stamp)) {
+        snapshot_stamp = loaded_stamp;
+    }
+} /* }}} */
+
+bool set_char(char* field, struct json_parser* json) { /* {{{ */
+    /* set a character field from the next value in json
+     * field - the field set the character in
+     * json  - the parser to read the character from
+     * return is whether the value was a string
      */
-    char* tmp = *line;
+    const char* str;
+    size_t      len;
 
-    do {
-        tmp = strstr(*line, "\",");
+    if (json_peek(json) != JSON_STRING || !json_string(json, &str, &len)) {
+        return false;
+    }
 
-        if (tmp == NULL) {
-            tmp = strstr(*line, "\"}");
-        }
-    } while (tmp != NULL && *(tmp - 1) == '\\');
+    *field = len > 0 ? *str : 0;
 
-    *field = strndup((*line) + 1, tmp - (*line) - 1);
+    return true;
+} /* }}} */
 
-    if (tmp == NULL || *field == NULL) {
-        tnc_fprintf(logfp, LOG_ERROR, "error parsing string @ %s", *line);
-    } else {
-        tnc_fprintf(logfp, LOG_DEBUG_VERBOSE, "string: %s", *field);
+bool set_date(time_t* field, struct json_parser* json) { /* {{{ */
+    /* set a time field from the next value in json
+     * field - the field set the time in
+     * json  - the parser to read the time from
+     * return is whether the value was a string
+     */
+    const char* str;
+    size_t      len;
+
+    if (json_peek(json) != JSON_STRING || !json_string(json, &str, &len)) {
+        return false;
     }
 
-    *line += tmp - *line;
+    *field = strtotime(str, len);
+
+    return true;
+} /* }}} */
+
+bool set_int(unsigned short* field, struct json_parser* json) { /* {{{ */
+    /* set an integer field from the next value in json
+     * field - the field set the integer in
+     * json  - the parser to read the integer from
+     * return is whether the value was a number
+     */
+    long value;
 
-    while (**line != ',' &&** line != '}') {
-        (*line)++;
+    if (json_peek(json) != JSON_NUMBER || !json_int(json, &value)) {
+        return false;
     }
+
+    *field = value;
+
+    return true;
 } /* }}} */
 
 void set_position_by_uuid(const char* uuid) { /* {{{ */
@@ -602,21 +1101,125 @@ void set_position_by_uuid(const char* uuid) { /* {{{ */
     /* get position & set it */
     pos = get_task_position_by_uuid(uuid);
 
-    if (pos > 0) {
+    if (pos >= 0) {
         selline = pos;
     }
 } /* }}} */
 
-time_t strtotime(const char* timestr) { /* {{{ */
+bool set_string(char** field, struct json_parser* json,
+                struct arena* arena) { /* {{{ */
+    /* set a string field from the next value in json
+     * field - the field set the string in
+     * json  - the parser to read the string from
+     * arena - the arena to copy the string into
+     * return is whether the value was a string
+     */
+    const char* str;
+    size_t      len;
+
+    if (json_peek(json) != JSON_STRING || !json_string(json, &str, &len)) {
+        return false;
+    }
+
+    *field = arena_strndup(arena, str, len);
+
+    return true;
+} /* }}} */
+
+bool set_tags(char** field, struct json_parser* json,
+              struct arena* arena) { /* {{{ */
+    /* set the tags field from the next value in json
+     * field - the field to store the comma separated tags in
+     * json  - the parser to read the tag array from
+     * arena - the arena to store the tags in
+     * return is whether the value was an array of strings
+     * the array is read twice, once to size the result and once to copy it
+     */
+    const char* start;
+    const char* str;
+    size_t      len;
+    size_t      taglen = 0;
+    char*       tags;
+    int         pass;
+    int         ret = 0;
+
+    if (json_peek(json) != JSON_ARRAY || !json_array_begin(json)) {
+        return false;
+    }
+
+    start = json->pos;
+    tags = NULL;
+
+    for (pass = 0; pass < 2; pass++) {
+        json->pos = start;
+        taglen = 0;
+
+        while ((ret = json_array_next(json)) == 1) {
+            if (!json_string(json, &str, &len)) {
+                return false;
+            }
+
+            if (taglen > 0 && tags != NULL) {
+                tags[taglen] = ',';
+            }
+
+            taglen += taglen > 0 ? 1 : 0;
+
+            if (tags != NULL) {
+                memcpy(tags + taglen, str, len);
+            }
+
+            taglen += len;
+        }
+
+        if (ret < 0) {
+            return false;
+        }
+
+        /* allocate the joined string once its size is known */
+        if (tags == NULL) {
+            tags = arena_alloc(arena, taglen + 1);
+
+            if (tags == NULL) {
+                return false;
+            }
+        }
+    }
+
+    *field = taglen > 0 ? tags : NULL;
+
+    return true;
+} /* }}} */
+
+time_t strtotime(const char* timestr, const size_t len) { /* {{{ */
     /* convert a string to a time_t
-     * timestr - the string to parse
-     * return is the time structure parsed
+     * timestr - the string to parse, either YYYYMMDDTHHMMSSZ or epoch seconds
+     * len     - the length of the string
+     * return is the time parsed
      */
-    struct tm tmr;
+    struct tm   tmr;
+    time_t      epoch = 0;
+    size_t      i;
+
+    /* epoch seconds */
+    if (len != 16 || timestr[8] != 'T') {
+        for (i = 0; i < len && timestr[i] >= '0' && timestr[i] <= '9'; i++) {
+            epoch = 10 * epoch + (timestr[i] - '0');
+        }
+
+        return epoch;
+    }
 
+    /* iso 8601 basic format, always in utc */
     memset(&tmr, 0, sizeof(tmr));
-    strptime(timestr, "%Y%m%dT%H%M%S%z", &tmr);
-    return mktime(&tmr);
+    tmr.tm_year = DIGITS2(timestr) * 100 + DIGITS2(timestr + 2) - 1900;
+    tmr.tm_mon  = DIGITS2(timestr + 4) - 1;
+    tmr.tm_mday = DIGITS2(timestr + 6);
+    tmr.tm_hour = DIGITS2(timestr + 9);
+    tmr.tm_min  = DIGITS2(timestr + 11);
+    tmr.tm_sec  = DIGITS2(timestr + 13);
+
+    return timegm(&tmr);
 } /* }}} */
 
 int task_background_command(const char* cmdfmt) { /* {{{ */
@@ -669,14 +1272,73 @@ int task_background_command(const char* cmdfmt) { /* {{{ */
 } /* }}} */
 
 void task_count() { /* {{{ */
-    taskcount = 0;
-    struct task* cur;
+    /* count the tasks in the list and rebuild the positional and uuid indexes */
+    struct task*        cur;
+    struct task**       tmp;
+    struct uuid_slot*   slots;
+    unsigned int        size;
+    uint64_t            hi;
+    uint64_t            lo;
+    int                 n = 0;
+
+    for (cur = head; cur != NULL; cur = cur->next) {
+        n++;
+    }
 
-    cur = head;
+    taskcount = n;
 
-    while (cur != NULL) {
-        taskcount++;
-        cur = cur->next;
+    /* grow the index if necessary */
+    if (n > task_index_size || task_index == NULL) {
+        tmp = realloc(task_index, (n + n / 2 + 16) * sizeof(struct task*));
+
+        if (tmp == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "could not allocate index for %d tasks", n);
+            free(task_index);
+            free(uuid_index);
+            task_index = NULL;
+            task_index_size = 0;
+            uuid_index = NULL;
+            uuid_index_mask = 0;
+            return;
+        }
+
+        task_index = tmp;
+        task_index_size = n + n / 2 + 16;
+    }
+
+    n = 0;
+
+    for (cur = head; cur != NULL; cur = cur->next) {
+        task_index[n++] = cur;
+    }
+
+    /* keep the uuid table at most half full */
+    for (size = 64; size < 2 * (unsigned int)taskcount; size *= 2);
+
+    if (size - 1 != uuid_index_mask || uuid_index == NULL) {
+        slots = realloc(uuid_index, size * sizeof(struct uuid_slot));
+
+        if (slots == NULL) {
+            tnc_fprintf(logfp, LOG_ERROR, "could not allocate uuid index for %d tasks", n);
+            free(uuid_index);
+            uuid_index = NULL;
+            uuid_index_mask = 0;
+            return;
+        }
+
+        uuid_index = slots;
+        uuid_index_mask = size - 1;
+    }
+
+    memset(uuid_index, 0xff, (uuid_index_mask + 1) * sizeof(struct uuid_slot));
+
+    for (n = 0; n < taskcount; n++) {
+        if (uuid_key(task_index[n]->uuid, &hi, &lo)) {
+            slots = uuid_index + uuid_index_find(hi, lo);
+            slots->hi = hi;
+            slots->lo = lo;
+            slots->pos = n;
+        }
     }
 } /* }}} */
 
@@ -769,4 +1431,150 @@ void task_modify(const char* argstr) { /* {{{ */
     free(cmd);
 } /* }}} */
 
+int tasks_loading_fd(void) { /* {{{ */
+    /* get the file descriptor a background load is reading from
+     * return is the descriptor, or -1 if no load is running
+     */
+    return loading ? task_load.fd : -1;
+} /* }}} */
+
+void unindex_task(struct task* this) { /* {{{ */
+    /* drop a task that was unlinked from the list from the indexes
+     * this - the task being removed
+     */
+    int         pos;
+    int         slot;
+    uint64_t    hi;
+    uint64_t    lo;
+
+    expire_sort_orders();
+    expire_schedule();
+
+    if (task_index == NULL) {
+        taskcount--;
+        return;
+    }
+
+    /* find the task, checking the uuid lookup in case of duplicate uuids */
+    pos = get_task_position_by_uuid(this->uuid);
+
+    if (pos < 0 || task_index[pos] != this) {
+        for (pos = 0; pos < taskcount && task_index[pos] != this; pos++);
+    }
+
+    if (pos == taskcount) {
+        return;
+    }
+
+    if (uuid_index != NULL && uuid_key(this->uuid, &hi, &lo)) {
+        slot = uuid_index_find(hi, lo);
+
+        if (uuid_index[slot].pos == pos) {
+            uuid_index_remove(slot);
+        }
+    }
+
+    memmove(task_index + pos, task_index + pos + 1,
+            (taskcount - pos - 1) * sizeof(struct task*));
+    taskcount--;
+
+    /* tasks below the removed one move up a line */
+    for (; uuid_index != NULL && pos < taskcount; pos++) {
+        if (uuid_key(task_index[pos]->uuid, &hi, &lo)) {
+            slot = uuid_index_find(hi, lo);
+
+            if (uuid_index[slot].pos == pos + 1) {
+                uuid_index[slot].pos = pos;
+            }
+        }
+    }
+} /* }}} */
+
+int uuid_index_find(const uint64_t hi, const uint64_t lo) { /* {{{ */
+    /* find the slot holding a binary uuid, or the empty slot it would go in */
+    unsigned int slot = (hi ^ lo) & uuid_index_mask;
+
+    while (uuid_index[slot].pos >= 0 &&
+           (uuid_index[slot].hi != hi || uuid_index[slot].lo != lo)) {
+        slot = (slot + 1) & uuid_index_mask;
+    }
+
+    return slot;
+} /* }}} */
+
+void uuid_index_remove(unsigned int slot) { /* {{{ */
+    /* empty a uuid slot, shifting back entries that probed past it */
+    unsigned int next = slot;
+    unsigned int home;
+
+    while (1) {
+        next = (next + 1) & uuid_index_mask;
+
+        if (uuid_index[next].pos < 0) {
+            break;
+        }
+
+        /* an entry may only move back if its home slot is not between slot and next */
+        home = (uuid_index[next].hi ^ uuid_index[next].lo) & uuid_index_mask;
+
+        if (((next - home) & uuid_index_mask) >= ((next - slot) & uuid_index_mask)) {
+            uuid_index[slot] = uuid_index[next];
+            slot = next;
+        }
+    }
+
+    uuid_index[slot].pos = -1;
+} /* }}} */
+
+bool uuid_key(const char* uuid, uint64_t* hi, uint64_t* lo) { /* {{{ */
+    /* parse a textual uuid into a 128 bit binary key
+     * uuid - the uuid string, 8-4-4-4-12 hexadecimal digits
+     * hi   - where the upper 64 bits will be stored
+     * lo   - where the lower 64 bits will be stored
+     * return is whether the uuid was well formed
+     */
+    uint64_t    key[2] = {0, 0};
+    int         digits = 0;
+    int         i;
+    char        c;
+
+    if (uuid == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < 36; i++) {
+        c = uuid[i];
+
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (c != '-') {
+                return false;
+            }
+
+            continue;
+        }
+
+        if (c >= '0' && c <= '9') {
+            c -= '0';
+        } else if (c >= 'a' && c <= 'f') {
+            c -= 'a' - 10;
+        } else if (c >= 'A' && c <= 'F') {
+            c -= 'A' - 10;
+        } else {
+            return false;
+        }
+
+        key[digits / 16] = (key[digits / 16] << 4) | c;
+        digits++;
+    }
+
+    if (uuid[36] != 0) {
+        return false;
+    }
+
+    *hi = key[0];
+    *lo = key[1];
+
+    return true;
+} /* }}} */
+
 // vim: et ts=4 sw=4 sts=4
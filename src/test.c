@@ -15,6 +15,8 @@
 #include "config.h"
 #include "formats.h"
 #include "log.h"
+#include "sort.h"
+#include "symbols.h"
 #include "tasks.h"
 #include "tasknc.h"
 #include "test.h"
@@ -22,9 +24,11 @@
 #ifdef TASKNC_INCLUDE_TESTS
 /* local functions {{{ */
 void test_compile_fmt(void);
+void test_parse_task(void);
 void test_result(const char* testname, const bool passed);
 void test_search(void);
 void test_set_var(void);
+void test_sort(void);
 void test_task_count(void);
 void test_trim(void);
 /* }}} */
@@ -40,10 +44,12 @@ void test(const char* args) { /* {{{ */
     };
     struct test tests[] = {
         {"compile_fmt", test_compile_fmt},
+        {"parse_task", test_parse_task},
         {"task_count", test_task_count},
         {"trim", test_trim},
         {"search", test_search},
         {"set_var", test_set_var},
+        {"sort", test_sort},
     };
     const int ntests = sizeof(tests) / sizeof(struct test);
     int i;
@@ -72,13 +78,15 @@ void test(const char* args) { /* {{{ */
 
 void test_compile_fmt() { /* {{{ */
     /* test compiling a format to a series of fields */
-    struct fmt_field*   fmts;
+    struct format*      fmts;
+    char*               buf = NULL;
     char*               eval;
     char*               teststr;
+    size_t              size = 0;
 
     teststr = "first $date $-8program_version $4program_name $10program_author ++?$search_string?SEARCH??++ ++?$active_filter??NO?++ second";
     fmts = compile_format_string(teststr);
-    eval = eval_format(fmts, NULL);
+    eval = eval_format(fmts, NULL, &buf, &size);
 
     if (eval != NULL) {
         printf("%s\n", eval);
@@ -88,13 +96,46 @@ void test_compile_fmt() { /* {{{ */
 
     teststr = "first uuid:'$uuid' pro:'$project' desc:'$description' $badvar second";
     fmts = compile_format_string(teststr);
-    eval = eval_format(fmts, head);
+    eval = eval_format(fmts, head, &buf, &size);
 
     if (eval != NULL) {
         printf("%s\n", eval);
     } else {
         puts("NULL returned");
     }
+
+    free(buf);
+} /* }}} */
+
+void test_parse_task(void) { /* {{{ */
+    /* test parsing a line of task export output */
+    struct json_parser  json;
+    struct arena*       arena = arena_create(0);
+    struct task*        this;
+    bool                pass;
+    const char*         line = "{\"id\":42,\"description\":\"say \\\"hi\\\" caf\\u00e9 a\\/b \\ud83d\\ude00\","
+                               "\"annotations\":[{\"entry\":\"20120110T231200Z\",\"description\":\"x]}\"}],"
+                               "\"due\":\"20120110T231200Z\",\"priority\":\"M\",\"project\":\"tasknc\","
+                               "\"tags\":[\"a\",\"b,c\"],\"urgency\":1.5,\"uuid\":\"0a1b\"},";
+
+    memset(&json, 0, sizeof(json));
+    json_init(&json, line, strlen(line));
+    this = parse_task(&json, arena);
+    json_free(&json);
+
+    pass = this != NULL && this != (struct task*) - 1 &&
+           this->index == 42 && this->priority == 'M' && this->due == 1326237120 &&
+           str_eq(this->description, "say \"hi\" caf\xc3\xa9 a/b \xf0\x9f\x98\x80") &&
+           str_eq(this->project, "tasknc") && str_eq(this->tags, "a,b,c") &&
+           str_eq(this->uuid, "0a1b");
+    test_result("parse_task", pass);
+
+    if (!pass && this != NULL && this != (struct task*) - 1) {
+        printf("%hu %c %ld '%s' '%s' '%s' '%s'\n", this->index, this->priority,
+               (long)this->due, this->description, this->project, this->tags, this->uuid);
+    }
+
+    arena_free(arena);
 } /* }}} */
 
 void test_result(const char* testname, const bool passed) { /* {{{ */
@@ -130,8 +171,7 @@ void test_search() { /* {{{ */
     asprintf(&addcmdstr, "task add pro:%s pri:%c %s", proj, pri, unique);
     cmdout = popen(addcmdstr, "r");
     pclose(cmdout);
-    free_tasks(head);
-    head = get_tasks(NULL);
+    reload_tasks();
 
     stdout = devnull;
     searchstring = strdup(unique);
@@ -175,12 +215,89 @@ void test_set_var(void) { /* {{{ */
     test_result("set int var", cfg.nc_timeout == 6969);
 } /* }}} */
 
+void test_sort(void) { /* {{{ */
+    /* check that the packed and parallel sorts order tasks like the serial sort */
+    const char*     modes[] = {"drpu", "rdp", "n", "DRPU"};
+    const char*     projects[] = {NULL, "home", "work", "tasknc", "garden"};
+    const char      priorities[] = {0, 'L', 'M', 'H'};
+    const int       nmodes = sizeof(modes) / sizeof(char*);
+    const int       n = 1000;
+    struct task*    tasks;
+    struct task**   shuffled;
+    struct task**   sorted[3];
+    struct task*    swap;
+    char*           uuids;
+    char*           name;
+    unsigned int    seed = 6969;
+    bool            pass;
+    int             i;
+    int             j;
+
+    tasks = calloc(n, sizeof(struct task));
+    uuids = calloc(n, UUIDLENGTH);
+    shuffled = calloc(n, sizeof(struct task*));
+
+    for (i = 0; i < 3; i++) {
+        sorted[i] = calloc(n, sizeof(struct task*));
+    }
+
+    /* tasks sharing fields, some without a due date or project */
+    for (i = 0; i < n; i++) {
+        tasks[i].index = i % 97 + 1;
+        tasks[i].priority = priorities[i % 4];
+        tasks[i].due = i % 7 == 0 ? 0 : 1326237120 + (time_t)(i * 37 % 60) * 86400;
+        tasks[i].project = (char*)projects[i % 5];
+        tasks[i].project_id = i % 5 != 0 ? intern(projects[i % 5], strlen(projects[i % 5])) : 0;
+        tasks[i].uuid = uuids + i * UUIDLENGTH;
+        sprintf(tasks[i].uuid, "%08x-0000-4000-8000-%012x", i * 2654435761u, i);
+        shuffled[i] = &tasks[i];
+    }
+
+    /* shuffle with a fixed seed so that failures can be reproduced */
+    for (i = n - 1; i > 0; i--) {
+        j = rand_r(&seed) % (i + 1);
+        swap = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = swap;
+    }
+
+    for (i = 0; i < nmodes; i++) {
+        for (j = 0; j < 3; j++) {
+            memcpy(sorted[j], shuffled, n * sizeof(struct task*));
+        }
+
+        pass = sort_array(sorted[0], n, modes[i], SORT_MERGE) &&
+               sort_array(sorted[1], n, modes[i], SORT_PACKED) &&
+               sort_array(sorted[2], n, modes[i], SORT_PARALLEL) &&
+               memcmp(sorted[0], sorted[1], n * sizeof(struct task*)) == 0 &&
+               memcmp(sorted[0], sorted[2], n * sizeof(struct task*)) == 0;
+        asprintf(&name, "sort %s", modes[i]);
+        test_result(name, pass);
+        free(name);
+    }
+
+    for (i = 0; i < 3; i++) {
+        free(sorted[i]);
+    }
+
+    free(shuffled);
+    free(uuids);
+    free(tasks);
+} /* }}} */
+
 void test_task_count(void) { /* {{{ */
-    /* check that the tasks are counted correctly */
-    int     tcnt;
-    FILE*   cmdout;
-    char*   line;
-    char*   cmdstr;
+    /* check that the tasks are counted and indexed correctly */
+    int             tcnt;
+    int             i;
+    struct task*    cur;
+    struct task*    this;
+    struct task*    new;
+    struct task**   before;
+    struct task**   after;
+    FILE*           cmdout;
+    char*           line;
+    char*           cmdstr;
+    bool            pass;
 
     task_count();
 
@@ -193,7 +310,77 @@ void test_task_count(void) { /* {{{ */
 
     test_result("task count", tcnt == taskcount);
 
+    /* check that the positional and uuid indexes follow the list */
+    for (cur = head, i = 0; cur != NULL && cur == get_task_by_position(i) &&
+         get_task_position_by_uuid(cur->uuid) == i; i++) {
+        cur = cur->next;
+    }
+
+    test_result("task index", cur == NULL && i == taskcount &&
+                get_task_by_position(i) == NULL);
+
     free(line);
+    free(cmdstr);
+
+    if (taskcount < 2) {
+        return;
+    }
+
+    /* give the last task an early due date and reload it, moving it in place */
+    before = calloc(taskcount, sizeof(struct task*));
+    after = calloc(taskcount, sizeof(struct task*));
+
+    for (i = 0; i < taskcount; i++) {
+        before[i] = get_task_by_position(i);
+    }
+
+    this = before[taskcount - 1];
+    asprintf(&cmdstr, "task %s modify due:20000101T000000Z", this->uuid);
+    cmdout = popen(cmdstr, "r");
+    pclose(cmdout);
+    free(cmdstr);
+    reload_task(this);
+    new = get_task_by_position(get_task_position_by_uuid(this->uuid));
+    pass = new != NULL && new != this;
+
+    /* the positional and uuid indexes must follow the moved task */
+    for (cur = head, i = 0; pass && cur != NULL; cur = cur->next, i++) {
+        pass = i < taskcount && cur == get_task_by_position(i) &&
+               get_task_position_by_uuid(cur->uuid) == i;
+        after[i] = cur;
+    }
+
+    pass = pass && i == taskcount;
+
+    /* a full sort of the old order with the reloaded copy must agree */
+    if (pass) {
+        before[taskcount - 1] = new;
+
+        for (i = 0; i < taskcount; i++) {
+            before[i]->prev = i > 0 ? before[i - 1] : NULL;
+            before[i]->next = i < taskcount - 1 ? before[i + 1] : NULL;
+        }
+
+        expire_sort_orders();
+        head = sort_wrapper(before[0]);
+        task_count();
+
+        for (cur = head, i = 0; pass && cur != NULL; cur = cur->next, i++) {
+            pass = cur == after[i];
+        }
+    }
+
+    test_result("task reinsert", pass);
+
+    cmdout = popen("task undo", "r");
+    pclose(cmdout);
+
+    if (new != NULL) {
+        reload_task(new);
+    }
+
+    free(before);
+    free(after);
 } /* }}} */
 
 void test_trim(void) { /* {{{ */